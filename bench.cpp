@@ -0,0 +1,315 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "game.hpp"
+#include "engine.hpp"
+#include "rle.hpp"
+
+// Headless timing runs, no GLUT anywhere in here. Every engine that runs
+// the same input is checked against the first one's population and
+// board hash, so the suite catches wrong answers as well as slow ones.
+
+struct BenchInput {
+    std::string label;
+    Board board;
+    Rule rule = CONWAY;
+};
+
+struct BenchResult {
+    double seconds = 0;
+    double cell_updates = 0;
+    std::vector<double> step_us;
+    size_t population = 0;
+    uint64_t hash = 0;
+    size_t peak_kb = 0; // above what the process held before the run
+    double active_tiles = 0; // mean per step, 0 if the engine doesn't say
+};
+
+size_t peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+double percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+BenchResult run_engine(Engine &engine, const BenchInput &input, int generations) {
+    typedef std::chrono::steady_clock clock;
+
+    BenchResult r;
+    r.step_us.reserve(generations);
+    engine.set_rule(input.rule);
+    engine.set_board(input.board);
+
+    for (int i = 0; i < generations; i++) {
+        r.cell_updates += engine.population();
+
+        auto t0 = clock::now();
+        engine.step();
+        double us = std::chrono::duration<double, std::micro>(clock::now() - t0).count();
+
+        r.step_us.push_back(us);
+        r.seconds += us / 1e6;
+        r.active_tiles += engine.active_tiles();
+    }
+    if (generations > 0) r.active_tiles /= generations;
+
+    Board end = engine.get_board();
+    r.population = end.size();
+    r.hash = board_hash(end);
+    std::sort(r.step_us.begin(), r.step_us.end());
+    return r;
+}
+
+// write()/read() the whole buffer, false if the pipe closed first
+bool write_all(int fd, const void *data, size_t size) {
+    const char *p = (const char *)data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool read_all(int fd, void *data, size_t size) {
+    char *p = (char *)data;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+// ru_maxrss only ever goes up, so every engine runs in its own child and
+// the result comes back over a pipe. Otherwise each row would show the
+// peak of every engine that ran before it.
+bool run_isolated(const std::string &name, int threads, const BenchInput &input,
+                  int generations, BenchResult &r) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        size_t baseline = peak_rss_kb();
+        std::unique_ptr<Engine> engine = make_engine(name, threads);
+        BenchResult child = run_engine(*engine, input, generations);
+        child.peak_kb = peak_rss_kb() - std::min(baseline, peak_rss_kb());
+
+        uint64_t count = child.step_us.size();
+        bool ok = write_all(fds[1], &child.seconds, sizeof(child.seconds)) &&
+                  write_all(fds[1], &child.cell_updates, sizeof(child.cell_updates)) &&
+                  write_all(fds[1], &child.population, sizeof(child.population)) &&
+                  write_all(fds[1], &child.hash, sizeof(child.hash)) &&
+                  write_all(fds[1], &child.peak_kb, sizeof(child.peak_kb)) &&
+                  write_all(fds[1], &child.active_tiles, sizeof(child.active_tiles)) &&
+                  write_all(fds[1], &count, sizeof(count)) &&
+                  write_all(fds[1], child.step_us.data(), count * sizeof(double));
+        _exit(ok ? 0 : 1);
+    }
+
+    close(fds[1]);
+    uint64_t count = 0;
+    bool ok = read_all(fds[0], &r.seconds, sizeof(r.seconds)) &&
+              read_all(fds[0], &r.cell_updates, sizeof(r.cell_updates)) &&
+              read_all(fds[0], &r.population, sizeof(r.population)) &&
+              read_all(fds[0], &r.hash, sizeof(r.hash)) &&
+              read_all(fds[0], &r.peak_kb, sizeof(r.peak_kb)) &&
+              read_all(fds[0], &r.active_tiles, sizeof(r.active_tiles)) &&
+              read_all(fds[0], &count, sizeof(count));
+    if (ok) {
+        r.step_us.resize(count);
+        ok = read_all(fds[0], r.step_us.data(), count * sizeof(double));
+    }
+    close(fds[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+bool load_input(const std::string &name, BenchInput &input) {
+    std::string path = find_pattern_file(name);
+    RleHeader header;
+    SetEngine loader(1);
+    if (path.empty() || !load_rle_file(path, loader, 1, 1, &header)) {
+        std::cerr << "Error opening file: " << name << std::endl;
+        return false;
+    }
+    if (!header.rule.empty() && !parse_rule(header.rule, input.rule)) {
+        std::cerr << "Unsupported rule in " << name << ": " << header.rule << std::endl;
+        return false;
+    }
+    input.label = name;
+    input.board = loader.get_board();
+    return true;
+}
+
+BenchInput soup_input(unsigned size, unsigned seed, const Rule &rule) {
+    BenchInput input;
+    input.label = "soup" + std::to_string(size) + "/seed" + std::to_string(seed);
+    if (rule != CONWAY) input.label += "/" + rule.str();
+    input.rule = rule;
+    initialize_from_random_soup(input.board, size, size, seed);
+    return input;
+}
+
+void usage(const char *prog) {
+    std::cerr << "usage: " << prog << " [pattern.rle | --suite]"
+              << " [--generations n] [--threads n] [--engine name|all]"
+              << " [--soup size] [--seed n] [--rule B3/S23]" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> patterns;
+    std::string engine_arg = "all";
+    int generations = -1;
+    int threads = std::thread::hardware_concurrency();
+    unsigned soup_size = 0, seed = 1;
+    bool suite = false;
+    Rule rule = CONWAY;
+    bool have_rule = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--generations" && has_value) generations = atoi(argv[++i]);
+        else if (arg == "--threads" && has_value) threads = atoi(argv[++i]);
+        else if (arg == "--engine" && has_value) engine_arg = argv[++i];
+        else if (arg == "--soup" && has_value) soup_size = atoi(argv[++i]);
+        else if (arg == "--seed" && has_value) seed = atoi(argv[++i]);
+        else if (arg == "--suite") suite = true;
+        else if (arg == "--rule" && has_value) {
+            if (!parse_rule(argv[++i], rule)) {
+                std::cerr << "Unsupported rule: " << argv[i] << std::endl;
+                return 1;
+            }
+            have_rule = true;
+        }
+        else if (arg[0] != '-') patterns.push_back(arg);
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (suite) {
+        patterns = {"2c5-spaceship-gun-p416.txt", "oscillator.txt",
+                    "queen_bee.txt", "smaller-ship.txt"};
+        if (generations < 0) generations = 100;
+    }
+    if (generations < 0) generations = 1000;
+
+    std::vector<BenchInput> inputs;
+    for (const std::string &name : patterns) {
+        BenchInput input;
+        if (!load_input(name, input)) return 1;
+        if (have_rule) input.rule = rule;
+        inputs.push_back(std::move(input));
+    }
+
+    if (suite) {
+        for (unsigned s = 1; s <= 3; s++) inputs.push_back(soup_input(256, s, rule));
+        // the compiled-in alternate rules and the generic kernel
+        inputs.push_back(soup_input(256, 1, HIGHLIFE));
+        inputs.push_back(soup_input(256, 1, DAY_AND_NIGHT));
+        inputs.push_back(soup_input(128, 1, Rule(1 << 3 | 1 << 4, 1 << 2 | 1 << 5)));
+    }
+    if (soup_size) inputs.push_back(soup_input(soup_size, seed, rule));
+
+    if (inputs.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<std::string> engines = engine_names();
+    if (engine_arg != "all") engines = {engine_arg};
+
+    printf("%d generations, %d threads\n", generations, threads);
+    printf("%-32s %-9s %10s %12s %9s %9s %9s %9s %9s %9s %9s  %s\n",
+           "input", "engine", "gen/s", "cells/s", "p50 us", "p90 us",
+           "p99 us", "max us", "peak MB", "active", "pop", "check");
+
+    bool all_match = true;
+    for (const BenchInput &input : inputs) {
+        bool have_ref = false;
+        size_t ref_pop = 0;
+        uint64_t ref_hash = 0;
+
+        for (const std::string &name : engines) {
+            const std::vector<std::string> &known = engine_names();
+            if (std::find(known.begin(), known.end(), name) == known.end()) {
+                std::cerr << "Unknown engine: " << name << std::endl;
+                return 1;
+            }
+
+            BenchResult r;
+            if (!run_isolated(name, threads, input, generations, r)) {
+                std::cerr << "Benchmark run failed: " << name << std::endl;
+                return 1;
+            }
+
+            const char *check = "ref";
+            if (have_ref) {
+                bool match = r.population == ref_pop && r.hash == ref_hash;
+                check = match ? "ok" : "MISMATCH";
+                all_match = all_match && match;
+            } else {
+                have_ref = true;
+                ref_pop = r.population;
+                ref_hash = r.hash;
+            }
+
+            char active[16] = "-";
+            if (r.active_tiles > 0) snprintf(active, sizeof(active), "%.1f", r.active_tiles);
+
+            printf("%-32s %-9s %10.1f %12.4g %9.1f %9.1f %9.1f %9.1f %9.1f %9s %9zu  %s\n",
+                   input.label.c_str(), name.c_str(),
+                   generations / r.seconds, r.cell_updates / r.seconds,
+                   percentile(r.step_us, 0.5), percentile(r.step_us, 0.9),
+                   percentile(r.step_us, 0.99),
+                   r.step_us.empty() ? 0.0 : r.step_us.back(),
+                   r.peak_kb / 1024.0, active, r.population, check);
+            fflush(stdout);
+        }
+    }
+
+    if (!all_match) {
+        std::cerr << "engines disagree on at least one input" << std::endl;
+        return 1;
+    }
+    return 0;
+}
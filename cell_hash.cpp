@@ -0,0 +1,50 @@
+#include "cell_hash.hpp"
+
+static constexpr uint64_t power(uint64_t base, uint64_t e) {
+    uint64_t r = 1;
+    for(; e; e >>= 1, base *= base) {
+        if(e & 1) r *= base;
+    }
+    return r;
+}
+
+static constexpr HashTables make_tables() {
+    HashTables t = {};
+    for(unsigned j = 0; j < 8; j++) {
+        for(uint64_t b = 0; b < 256; b++) {
+            t.pow_x[j][b] = power(HASH_A, b << (8 * j));
+            t.pow_y[j][b] = power(HASH_B, b << (8 * j));
+
+            uint64_t sum = 0;
+            for(unsigned i = 0; i < 8; i++) {
+                if(b & (1u << i)) sum += power(HASH_A, 8 * j + i);
+            }
+            t.row[j][b] = sum;
+        }
+    }
+    for(unsigned k = 0; k < 64; k++) {
+        t.pow2_x[k] = power(HASH_A, (uint64_t)1 << k);
+        t.pow2_y[k] = power(HASH_B, (uint64_t)1 << k);
+    }
+    return t;
+}
+
+constexpr HashTables HASH_TABLES = make_tables();
+
+static uint64_t table_pow(const uint64_t (&table)[8][256], uint64_t e) {
+    uint64_t r = table[0][e & 255];
+    for(unsigned j = 1; j < 8 && (e >>= 8); j++) r *= table[j][e & 255];
+    return r;
+}
+
+uint64_t hash_pow_x(int64_t e) { return table_pow(HASH_TABLES.pow_x, (uint64_t)e); }
+uint64_t hash_pow_y(int64_t e) { return table_pow(HASH_TABLES.pow_y, (uint64_t)e); }
+
+uint64_t hash_pow2_x(unsigned k) { return HASH_TABLES.pow2_x[k & 63]; }
+uint64_t hash_pow2_y(unsigned k) { return HASH_TABLES.pow2_y[k & 63]; }
+
+uint64_t cells_hash(const std::vector<Cell> &cells) {
+    uint64_t h = 0;
+    for(const Cell &c : cells) h += cell_hash((int32_t)c.first, (int32_t)c.second);
+    return h;
+}
@@ -0,0 +1,65 @@
+#ifndef CELL_HASH_HPP
+#define CELL_HASH_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "game.hpp"
+
+// Positional board hash. A live cell at (x, y), read as signed 32 bit
+// coordinates, contributes HASH_A^x * HASH_B^y and the board hash is the
+// sum of those mod 2^64. Both bases are odd, so negative powers exist.
+//
+// Being a sum, it updates from births and deaths without touching the rest
+// of the board. Being a product of powers, moving a board by (dx, dy)
+// multiplies its hash by HASH_A^dx * HASH_B^dy, so hashing relative to the
+// bounding box corner gives the same value wherever a spaceship has got to.
+// The low bits are weak (bit 0 is just the population parity), mix the
+// value before using it as a table key.
+
+constexpr uint64_t HASH_A = 0x9E3779B97F4A7C15ull;
+constexpr uint64_t HASH_B = 0x94D049BB133111EBull;
+
+struct HashTables {
+    // pow_x[j][b] = HASH_A^(b << 8j), pow_y the same for HASH_B
+    uint64_t pow_x[8][256];
+    uint64_t pow_y[8][256];
+    uint64_t pow2_x[64];
+    uint64_t pow2_y[64];
+    // row[j][b] = sum of HASH_A^(8j + i) over the set bits i of b
+    uint64_t row[8][256];
+};
+
+// built at compile time in cell_hash.cpp
+extern const HashTables HASH_TABLES;
+
+// HASH_A^e and HASH_B^e. Exponents are taken mod 2^64, which is exact since
+// the powers of an odd number repeat every 2^62 at most.
+uint64_t hash_pow_x(int64_t e);
+uint64_t hash_pow_y(int64_t e);
+
+// HASH_A^(2^k) and HASH_B^(2^k)
+uint64_t hash_pow2_x(unsigned k);
+uint64_t hash_pow2_y(unsigned k);
+
+// Sum of HASH_A^i over the set bits i of a 64 cell row starting at x = 0.
+// Inline, the tile engine calls it for every row that changes.
+inline uint64_t hash_row(uint64_t bits) {
+    // fixed trip count, an early exit costs more in mispredicts than it saves
+    uint64_t h = 0;
+    for(unsigned j = 0; j < 8; j++) h += HASH_TABLES.row[j][(bits >> (8 * j)) & 255];
+    return h;
+}
+
+inline uint64_t cell_hash(int32_t x, int32_t y) {
+    return hash_pow_x(x) * hash_pow_y(y);
+}
+
+// Hash of the same board moved by (dx, dy)
+inline uint64_t hash_translate(uint64_t h, int64_t dx, int64_t dy) {
+    return h * hash_pow_x(dx) * hash_pow_y(dy);
+}
+
+uint64_t cells_hash(const std::vector<Cell> &cells);
+
+#endif // CELL_HASH_HPP
@@ -0,0 +1,332 @@
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "census.hpp"
+#include "cycle.hpp"
+#include "engine.hpp"
+#include "thread_pool.hpp"
+#include "tile_engine.hpp"
+#include "xoshiro.hpp"
+
+namespace {
+
+// a soup counts as settled once its population has repeated with some
+// period up to MAX_PERIOD for a good while
+const unsigned MAX_PERIOD = 60;
+const unsigned SETTLE_WINDOW = 120;
+const unsigned SETTLE_CHECK = 30;
+
+// generations of cells ORed together before splitting into objects, has to
+// cover MAX_PERIOD so every object is seen in all its phases
+const unsigned UNION_GENERATIONS = 64;
+
+// how long an object alone gets to show its period
+const unsigned ISOLATED_GENERATIONS = 512;
+const size_t ISOLATED_MAX_PERIOD = 256;
+
+typedef std::pair<int32_t, int32_t> Point;
+
+uint64_t point_key(int32_t x, int32_t y) {
+    return (uint64_t)(uint32_t)y << 32 | (uint32_t)x;
+}
+
+Point key_point(uint64_t key) {
+    return {(int32_t)(uint32_t)key, (int32_t)(key >> 32)};
+}
+
+void get_points(const Engine &engine, std::vector<Point> &points) {
+    std::vector<Cell> cells;
+    engine.get_cells(cells);
+    points.clear();
+    for(const Cell &c : cells) points.push_back({(int32_t)c.first, (int32_t)c.second});
+}
+
+bool population_settled(const std::vector<size_t> &pops) {
+    size_t n = pops.size();
+    for(unsigned p = 1; p <= MAX_PERIOD; p++){
+        size_t window = std::max<size_t>(2 * p, SETTLE_WINDOW);
+        if(n < window + p) break;
+        bool same = true;
+        for(size_t i = n - window; i < n && same; i++) same = pops[i] == pops[i - p];
+        if(same) return true;
+    }
+    return false;
+}
+
+// Smallest of the 8 rotations/reflections, moved to the origin, written
+// out as "x,y;" pairs sorted by row. Same shape in any orientation or
+// place gives the same string.
+std::string canonical(const std::vector<Point> &points, std::vector<Point> *shape) {
+    std::string best;
+    std::vector<Point> t(points.size());
+    for(int o = 0; o < 8; o++){
+        int32_t min_x = INT32_MAX, min_y = INT32_MAX;
+        for(size_t i = 0; i < points.size(); i++){
+            int32_t x = points[i].first, y = points[i].second;
+            if(o & 4) std::swap(x, y);
+            if(o & 1) x = -x;
+            if(o & 2) y = -y;
+            t[i] = {y, x};
+            min_x = std::min(min_x, x);
+            min_y = std::min(min_y, y);
+        }
+        for(Point &p : t) p = {p.first - min_y, p.second - min_x};
+        std::sort(t.begin(), t.end());
+
+        std::string key;
+        char buf[24];
+        for(const Point &p : t){
+            snprintf(buf, sizeof(buf), "%d,%d;", p.second, p.first);
+            key += buf;
+        }
+        if(o == 0 || key < best){
+            best = key;
+            if(shape){
+                shape->clear();
+                for(const Point &p : t) shape->push_back({p.second, p.first});
+            }
+        }
+    }
+    return best;
+}
+
+uint64_t fnv1a(const std::string &s) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for(unsigned char c : s) h = (h ^ c) * 0x100000001b3ull;
+    return h;
+}
+
+std::string object_code(const char *prefix, uint64_t n, const std::string &key) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s%llu_%08llx", prefix, (unsigned long long)n,
+             (unsigned long long)(fnv1a(key) & 0xffffffffull));
+    return buf;
+}
+
+// Runs the object alone until it repeats. The canonical form is the
+// smallest over every phase, so all phases of an oscillator get one code.
+CensusEntry identify(const std::vector<Point> &points, const Rule &rule) {
+    TileEngine engine;
+    engine.set_rule(rule);
+    engine.clear();
+    for(const Point &p : points) engine.add_run(p.first, p.second, 1);
+    engine.commit();
+
+    CensusEntry entry;
+    CycleDetector detector(ISOLATED_MAX_PERIOD);
+    detector.observe(engine, 0);
+    for(uint64_t gen = 1; gen <= ISOLATED_GENERATIONS; gen++){
+        engine.step();
+        if(detector.observe(engine, gen)) break;
+    }
+
+    std::vector<Point> cells, shape;
+    if(!detector.confirmed()){
+        // grew, died or took too long: keep it under its starting shape
+        std::string key = canonical(points, &shape);
+        entry.code = object_code("xx", points.size(), key);
+        entry.population = points.size();
+    } else {
+        const Cycle &c = detector.cycle();
+        std::string best;
+        for(uint64_t i = 0; i < c.period; i++){
+            get_points(engine, cells);
+            std::vector<Point> phase_shape;
+            std::string key = canonical(cells, &phase_shape);
+            if(i == 0 || key < best){
+                best = key;
+                shape = phase_shape;
+            }
+            engine.step();
+        }
+        entry.period = c.period;
+        entry.dx = c.dx;
+        entry.dy = c.dy;
+        entry.population = shape.size();
+        if(c.dx || c.dy) entry.code = object_code("xq", c.period, best);
+        else if(c.period == 1) entry.code = object_code("xs", shape.size(), best);
+        else entry.code = object_code("xp", c.period, best);
+    }
+    for(const Point &p : shape) entry.shape.insert({(unsigned)p.first, (unsigned)p.second});
+    return entry;
+}
+
+// codes of the common objects, worked out once through identify() so they
+// can't drift from what the census produces
+const std::unordered_map<std::string, std::string> &known_names() {
+    static const std::unordered_map<std::string, std::string> names = [] {
+        static const char *const OBJECTS[][2] = {
+            {"block", "2o$2o!"},
+            {"beehive", "b2o$o2bo$b2o!"},
+            {"loaf", "b2o$o2bo$bobo$2bo!"},
+            {"boat", "2o$obo$bo!"},
+            {"ship", "2o$obo$b2o!"},
+            {"tub", "bo$obo$bo!"},
+            {"pond", "b2o$o2bo$o2bo$b2o!"},
+            {"long boat", "2o$obo$bobo$2bo!"},
+            {"barge", "bo$obo$bobo$2bo!"},
+            {"eater", "2o$obo$2bo$2b2o!"},
+            {"blinker", "3o!"},
+            {"toad", "b3o$3o!"},
+            {"beacon", "2o$2o$2b2o$2b2o!"},
+            {"pentadecathlon", "2bo4bo2b$2ob4ob2o$2bo4bo!"},
+            {"glider", "bo$2bo$3o!"},
+            {"LWSS", "bo2bo$o$o3bo$4o!"},
+            {"MWSS", "3bo$bo3bo$o$o4bo$5o!"},
+            {"HWSS", "3b2o$bo4bo$o$o5bo$6o!"},
+        };
+        std::unordered_map<std::string, std::string> names;
+        for(const auto &object : OBJECTS){
+            Board board;
+            initialize_from_RLE(board, object[1], 0, 0);
+            std::vector<Point> points;
+            for(const Cell &c : board) points.push_back({(int32_t)c.first, (int32_t)c.second});
+            names[identify(points, CONWAY).code] = object[0];
+        }
+        return names;
+    }();
+    return names;
+}
+
+} // namespace
+
+void Census::add(const CensusEntry &entry, uint64_t soup) {
+    auto it = objects.find(entry.code);
+    if(it == objects.end()){
+        it = objects.emplace(entry.code, entry).first;
+        it->second.count = 0;
+        it->second.example_soup = soup;
+    }
+    // tasks run in any order, keep the lowest seed so reruns agree
+    it->second.example_soup = std::min(it->second.example_soup, soup);
+    it->second.count++;
+}
+
+void Census::merge(const Census &other) {
+    for(const auto &[code, entry] : other.objects){
+        auto it = objects.find(code);
+        if(it == objects.end()){
+            objects.emplace(code, entry);
+        } else {
+            it->second.count += entry.count;
+            it->second.example_soup = std::min(it->second.example_soup, entry.example_soup);
+        }
+    }
+    soups += other.soups;
+    unstable += other.unstable;
+    generations += other.generations;
+}
+
+std::vector<const CensusEntry *> Census::sorted() const {
+    std::vector<const CensusEntry *> out;
+    for(const auto &[code, entry] : objects) out.push_back(&entry);
+    std::stable_sort(out.begin(), out.end(), [](const CensusEntry *a, const CensusEntry *b) {
+        return a->count > b->count;
+    });
+    return out;
+}
+
+void load_soup(Engine &engine, uint64_t seed, unsigned size) {
+    // row-major words, the seeded initialize_from_random_soup draws the same
+    Xoshiro256 rng(seed);
+    engine.clear();
+    for(unsigned y = 0; y < size; y++){
+        for(unsigned x = 0; x < size; x += 64){
+            uint64_t bits = rng.next();
+            if(size - x < 64) bits &= (1ull << (size - x)) - 1;
+            engine.add_word(x, y, bits);
+        }
+    }
+    engine.commit();
+}
+
+void run_soup(uint64_t seed, const CensusOptions &opts, Census &census) {
+    TileEngine engine;
+    engine.set_rule(opts.rule);
+    load_soup(engine, seed, opts.soup_size);
+
+    census.soups++;
+
+    std::vector<size_t> pops = {engine.population()};
+    bool settled = false;
+    uint64_t gen = 0;
+    while(gen < opts.max_generations){
+        engine.step();
+        gen++;
+        pops.push_back(engine.population());
+        if(gen % SETTLE_CHECK == 0 && population_settled(pops)){
+            settled = true;
+            break;
+        }
+    }
+    census.generations += gen;
+    if(!settled){
+        census.unstable++;
+        return;
+    }
+
+    // Every cell any object touches over a few periods. Objects whose
+    // footprints stay 3 or more apart can never interact, anything closer
+    // is counted as one (pseudo) object.
+    std::unordered_set<uint64_t> footprint;
+    std::vector<Point> cells;
+    for(unsigned i = 0; i < UNION_GENERATIONS; i++){
+        if(i) engine.step();
+        get_points(engine, cells);
+        for(const Point &p : cells) footprint.insert(point_key(p.first, p.second));
+    }
+    census.generations += UNION_GENERATIONS - 1;
+
+    std::unordered_map<uint64_t, unsigned> component;
+    unsigned components = 0;
+    std::deque<uint64_t> queue;
+    for(uint64_t start : footprint){
+        if(component.count(start)) continue;
+        component[start] = components;
+        queue.push_back(start);
+        while(!queue.empty()){
+            Point p = key_point(queue.front());
+            queue.pop_front();
+            for(int dy = -2; dy <= 2; dy++){
+                for(int dx = -2; dx <= 2; dx++){
+                    uint64_t key = point_key(p.first + dx, p.second + dy);
+                    if(footprint.count(key) && component.emplace(key, components).second)
+                        queue.push_back(key);
+                }
+            }
+        }
+        components++;
+    }
+
+    std::vector<std::vector<Point>> objects(components);
+    for(const Point &p : cells)
+        objects[component[point_key(p.first, p.second)]].push_back(p);
+
+    const auto *names = opts.rule == CONWAY ? &known_names() : nullptr;
+    for(const auto &object : objects){
+        // a footprint whose cells all died off in the last phase
+        if(object.empty()) continue;
+        CensusEntry entry = identify(object, opts.rule);
+        if(names){
+            auto it = names->find(entry.code);
+            if(it != names->end()) entry.name = it->second;
+        }
+        census.add(entry, seed);
+    }
+}
+
+Census run_census(const CensusOptions &opts, ThreadPool &pool) {
+    // one census per worker, merged at the end, so no locking per object
+    std::vector<Census> parts(pool.size());
+    if(opts.rule == CONWAY) known_names();
+    pool.parallel_for(opts.soups, [&](size_t i, int worker) {
+        run_soup(opts.seed + i, opts, parts[worker]);
+    });
+
+    Census census;
+    for(const Census &part : parts) census.merge(part);
+    return census;
+}
@@ -0,0 +1,59 @@
+#ifndef CENSUS_HPP
+#define CENSUS_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "game.hpp"
+#include "rule.hpp"
+
+class Engine;
+class ThreadPool;
+
+// Batch soup search: lots of small seeded soups, each run until its
+// population goes periodic, then whatever is left gets split into objects
+// and every object is identified by running it on its own.
+
+struct CensusOptions {
+    uint64_t soups = 1000;
+    uint64_t seed = 1;           // soup i uses seed + i
+    unsigned soup_size = 16;     // soups are soup_size x soup_size at 50%
+    unsigned max_generations = 30000;
+    Rule rule = CONWAY;
+};
+
+struct CensusEntry {
+    std::string code;    // xs<pop>/xp<period>/xq<period> + '_' + shape hash
+    std::string name;    // common name when it's one we know, else empty
+    uint64_t period = 0; // 0 when the object never settled on its own
+    int64_t dx = 0, dy = 0;
+    size_t population = 0;
+    uint64_t count = 0;
+    uint64_t example_soup = 0; // seed of the first soup that made one
+    Board shape;               // canonical phase and orientation
+};
+
+struct Census {
+    std::map<std::string, CensusEntry> objects; // by code
+    uint64_t soups = 0;
+    uint64_t unstable = 0;     // hit max_generations without settling
+    uint64_t generations = 0;  // summed over every soup
+
+    void add(const CensusEntry &entry, uint64_t soup);
+    void merge(const Census &other);
+    // most common first
+    std::vector<const CensusEntry *> sorted() const;
+};
+
+// Loads soup `seed` into the engine at the origin
+void load_soup(Engine &engine, uint64_t seed, unsigned size);
+
+// Runs one soup to stability and adds its objects to census
+void run_soup(uint64_t seed, const CensusOptions &opts, Census &census);
+
+// Every soup in opts, spread over the pool, one soup per task
+Census run_census(const CensusOptions &opts, ThreadPool &pool);
+
+#endif // CENSUS_HPP
@@ -0,0 +1,115 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "census.hpp"
+#include "game.hpp"
+#include "rle.hpp"
+#include "thread_pool.hpp"
+
+// Soup search driver: runs a batch of seeded soups over a thread pool and
+// prints what settled out of them, most common first.
+
+void usage(const char *prog) {
+    std::cerr << "usage: " << prog << " [--soups n] [--seed n] [--threads n]"
+              << " [--size n] [--rule B3/S23] [--max-generations n] [--top k]"
+              << " [--scaling] [--show seed]" << std::endl;
+}
+
+double timed_census(const CensusOptions &opts, int threads, Census &census) {
+    typedef std::chrono::steady_clock clock;
+    ThreadPool pool(threads);
+    auto t0 = clock::now();
+    census = run_census(opts, pool);
+    return std::chrono::duration<double>(clock::now() - t0).count();
+}
+
+void print_census(const Census &census, size_t top) {
+    printf("%8s  %-22s %-16s %6s %10s %5s  %s\n",
+           "count", "code", "name", "period", "move", "pop", "soup");
+    size_t shown = 0;
+    for (const CensusEntry *e : census.sorted()) {
+        if (top && shown++ == top) break;
+        std::string move = "-";
+        if (e->dx || e->dy) move = "(" + std::to_string(e->dx) + "," + std::to_string(e->dy) + ")";
+        std::string period = e->period ? std::to_string(e->period) : "?";
+        printf("%8llu  %-22s %-16s %6s %10s %5zu  %llu\n",
+               (unsigned long long)e->count, e->code.c_str(),
+               e->name.empty() ? "-" : e->name.c_str(), period.c_str(),
+               move.c_str(), e->population, (unsigned long long)e->example_soup);
+    }
+}
+
+int main(int argc, char** argv) {
+    CensusOptions opts;
+    int threads = std::thread::hardware_concurrency();
+    size_t top = 30;
+    bool scaling = false;
+    bool show = false;
+    uint64_t show_seed = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--soups" && has_value) opts.soups = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && has_value) opts.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--threads" && has_value) threads = atoi(argv[++i]);
+        else if (arg == "--size" && has_value) opts.soup_size = atoi(argv[++i]);
+        else if (arg == "--max-generations" && has_value) opts.max_generations = atoi(argv[++i]);
+        else if (arg == "--top" && has_value) top = atoi(argv[++i]);
+        else if (arg == "--scaling") scaling = true;
+        else if (arg == "--show" && has_value) {
+            show = true;
+            show_seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--rule" && has_value) {
+            if (!parse_rule(argv[++i], opts.rule)) {
+                std::cerr << "Unsupported rule: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (threads < 1) threads = 1;
+    if (opts.soup_size < 1) opts.soup_size = 1;
+
+    if (show) {
+        // the soup exactly as the census ran it, to paste into a viewer
+        Board board;
+        initialize_from_random_soup(board, opts.soup_size, opts.soup_size, show_seed);
+        return write_rle(stdout, board, opts.rule.str()) ? 0 : 1;
+    }
+
+    if (scaling) {
+        printf("%7s %10s %10s %8s\n", "threads", "seconds", "soups/s", "speedup");
+        double base = 0;
+        for (int t = 1; ; t *= 2) {
+            if (t > threads) t = threads;
+            Census census;
+            double seconds = timed_census(opts, t, census);
+            double rate = census.soups / seconds;
+            if (t == 1) base = rate;
+            printf("%7d %10.3f %10.1f %8.2f\n", t, seconds, rate, rate / base);
+            if (t == threads) break;
+        }
+        return 0;
+    }
+
+    Census census;
+    double seconds = timed_census(opts, threads, census);
+    printf("%llu soups (%ux%u, %s), %llu unstable, %llu generations, "
+           "%.3f s, %.1f soups/s on %d threads\n",
+           (unsigned long long)census.soups, opts.soup_size, opts.soup_size,
+           opts.rule.str().c_str(), (unsigned long long)census.unstable,
+           (unsigned long long)census.generations, seconds,
+           census.soups / seconds, threads);
+    print_census(census, top);
+    return 0;
+}
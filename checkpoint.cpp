@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FAST_LIFE_HAVE_MMAP 1
+#endif
+
+#include "checkpoint.hpp"
+
+static const char CHECKPOINT_MAGIC[8] = {'F', 'L', 'I', 'F', 'E', 'C', 'K', 'P'};
+static const uint32_t CHECKPOINT_VERSION = 1;
+static const uint32_t ENDIAN_MARK = 0x01020304;
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint64_t generation;
+    uint16_t birth, survive;
+    uint32_t reserved;
+    int32_t min_x, min_y, max_x, max_y;
+    uint64_t population;
+    uint64_t block_count;
+};
+
+struct CheckpointEntry {
+    uint32_t tx, ty;
+    uint64_t row_mask;
+};
+
+static_assert(sizeof(CheckpointHeader) == 64, "checkpoint header layout");
+static_assert(sizeof(CheckpointEntry) == 16, "checkpoint index layout");
+
+bool write_checkpoint(const std::string &path, std::vector<CellBlock> &blocks,
+                      uint64_t generation, const Rule &rule, CheckpointInfo *info) {
+
+    // row major so files of the same board come out identical
+    std::sort(blocks.begin(), blocks.end(), [](const CellBlock &a, const CellBlock &b) {
+        return a.y0 != b.y0 ? a.y0 < b.y0 : a.x0 < b.x0;
+    });
+
+    CheckpointHeader header = {};
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.endian = ENDIAN_MARK;
+    header.generation = generation;
+    header.birth = rule.birth;
+    header.survive = rule.survive;
+    header.min_x = header.min_y = INT32_MAX;
+    header.max_x = header.max_y = INT32_MIN;
+
+    std::vector<CheckpointEntry> index;
+    index.reserve(blocks.size());
+    for(const CellBlock &b : blocks) {
+        CheckpointEntry e = {b.x0 >> 6, b.y0 >> 6, 0};
+        uint64_t columns = 0;
+        for(unsigned r = 0; r < 64; r++) {
+            if(b.rows[r] == 0) continue;
+            e.row_mask |= (uint64_t)1 << r;
+            columns |= b.rows[r];
+            header.population += __builtin_popcountll(b.rows[r]);
+        }
+        if(e.row_mask == 0) continue;
+        index.push_back(e);
+
+        // 64 aligned blocks never straddle the signed wrap, so the signed
+        // corner plus offsets is exact
+        int32_t x0 = (int32_t)b.x0, y0 = (int32_t)b.y0;
+        header.min_x = std::min(header.min_x, x0 + __builtin_ctzll(columns));
+        header.max_x = std::max(header.max_x, x0 + 63 - __builtin_clzll(columns));
+        header.min_y = std::min(header.min_y, y0 + __builtin_ctzll(e.row_mask));
+        header.max_y = std::max(header.max_y, y0 + 63 - __builtin_clzll(e.row_mask));
+    }
+    header.block_count = index.size();
+    if(index.empty()) {
+        header.min_x = header.min_y = 0;
+        header.max_x = header.max_y = -1;
+    }
+
+    std::string tmp = path + ".tmp";
+    FILE *file = fopen(tmp.c_str(), "wb");
+    if(!file) return false;
+
+    std::vector<char> buffer(1 << 20);
+    setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if(ok && !index.empty()) {
+        ok = fwrite(index.data(), sizeof(CheckpointEntry), index.size(), file) == index.size();
+    }
+    for(const CellBlock &b : blocks) {
+        for(unsigned r = 0; ok && r < 64; r++) {
+            if(b.rows[r] != 0) ok = fwrite(&b.rows[r], sizeof(uint64_t), 1, file) == 1;
+        }
+    }
+
+    ok = fflush(file) == 0 && ok;
+#ifdef FAST_LIFE_HAVE_MMAP
+    ok = ok && fsync(fileno(file)) == 0;
+#endif
+    ok = fclose(file) == 0 && ok;
+    ok = ok && rename(tmp.c_str(), path.c_str()) == 0;
+    if(!ok) {
+        remove(tmp.c_str());
+        return false;
+    }
+
+    if(info) {
+        info->generation = generation;
+        info->rule = rule;
+        info->population = header.population;
+        info->min_x = header.min_x;
+        info->min_y = header.min_y;
+        info->max_x = header.max_x;
+        info->max_y = header.max_y;
+    }
+    return true;
+}
+
+bool save_checkpoint(const std::string &path, const Engine &engine, uint64_t generation) {
+    std::vector<CellBlock> blocks;
+    engine.get_blocks(blocks);
+    return write_checkpoint(path, blocks, generation, engine.get_rule());
+}
+
+static bool load_checkpoint_data(const char *data, size_t size, Engine &engine,
+                                 CheckpointInfo *info) {
+    CheckpointHeader header;
+    if(size < sizeof(header)) return false;
+    memcpy(&header, data, sizeof(header));
+
+    if(memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 ||
+       header.version != CHECKPOINT_VERSION || header.endian != ENDIAN_MARK) {
+        return false;
+    }
+
+    size_t rest = size - sizeof(header);
+    if(header.block_count > rest / sizeof(CheckpointEntry)) return false;
+
+    const CheckpointEntry *index = (const CheckpointEntry *)(data + sizeof(header));
+    const char *rows = (const char *)(index + header.block_count);
+    const char *end = data + size;
+
+    // check the row count adds up before touching the engine
+    uint64_t total_rows = 0;
+    for(uint64_t i = 0; i < header.block_count; i++) {
+        total_rows += __builtin_popcountll(index[i].row_mask);
+    }
+    if(total_rows != (uint64_t)(end - rows) / sizeof(uint64_t) ||
+       (end - rows) % sizeof(uint64_t) != 0) {
+        return false;
+    }
+
+    Rule rule(header.birth, header.survive);
+    engine.clear();
+    engine.set_rule(rule);
+    CellBlock block;
+    for(uint64_t i = 0; i < header.block_count; i++) {
+        block.x0 = index[i].tx << 6;
+        block.y0 = index[i].ty << 6;
+        memset(block.rows, 0, sizeof(block.rows));
+        for(uint64_t mask = index[i].row_mask; mask; mask &= mask - 1) {
+            memcpy(&block.rows[__builtin_ctzll(mask)], rows, sizeof(uint64_t));
+            rows += sizeof(uint64_t);
+        }
+        engine.add_block(block);
+    }
+    engine.commit();
+
+    if(info) {
+        info->generation = header.generation;
+        info->rule = rule;
+        info->population = header.population;
+        info->min_x = header.min_x;
+        info->min_y = header.min_y;
+        info->max_x = header.max_x;
+        info->max_y = header.max_y;
+    }
+    return true;
+}
+
+bool load_checkpoint(const std::string &path, Engine &engine, CheckpointInfo *info) {
+#ifdef FAST_LIFE_HAVE_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+
+    struct stat st;
+    void *data = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if(data == MAP_FAILED) return false;
+
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    bool ok = load_checkpoint_data((const char *)data, st.st_size, engine, info);
+    munmap(data, st.st_size);
+    return ok;
+#else
+    FILE *file = fopen(path.c_str(), "rb");
+    if(!file) return false;
+
+    std::vector<char> data;
+    char chunk[1 << 16];
+    size_t got;
+    while((got = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + got);
+    }
+    fclose(file);
+    return load_checkpoint_data(data.data(), data.size(), engine, info);
+#endif
+}
+
+// the thread only starts once every member it touches has been built
+CheckpointWriter::CheckpointWriter(const std::string &path) : path(path) {
+    writer = std::thread(&CheckpointWriter::writer_loop, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+}
+
+bool CheckpointWriter::submit(const Engine &engine, uint64_t generation) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(pending) return false;
+    }
+
+    // only the writer thread touches board while pending is set, so
+    // spare is ours to fill without holding the lock
+    engine.snapshot(spare);
+
+    std::lock_guard<std::mutex> guard(lock);
+    std::swap(board, spare);
+    this->generation = generation;
+    rule = engine.get_rule();
+    pending = true;
+    wake.notify_one();
+    return true;
+}
+
+bool CheckpointWriter::wait() {
+    std::unique_lock<std::mutex> guard(lock);
+    idle.wait(guard, [this] { return !pending; });
+    return last_ok;
+}
+
+void CheckpointWriter::writer_loop() {
+    std::unique_lock<std::mutex> guard(lock);
+    while(true) {
+        wake.wait(guard, [this] { return pending || stopping; });
+        if(!pending) return;
+
+        uint64_t gen = generation;
+        Rule r = rule;
+        guard.unlock();
+        board.to_blocks();
+        bool ok = write_checkpoint(path, board.blocks, gen, r);
+        guard.lock();
+
+        last_ok = ok;
+        pending = false;
+        idle.notify_all();
+    }
+}
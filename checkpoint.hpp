@@ -0,0 +1,81 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine.hpp"
+#include "rule.hpp"
+
+// Binary snapshot of a running board. Layout, in native byte order (the
+// header has a marker so a foreign file is refused rather than misread):
+//
+//   header     64 bytes, see CheckpointHeader in checkpoint.cpp
+//   index      one entry per 64x64 block: tile x, tile y and a 64 bit
+//              mask of which rows are non-empty
+//   rows       for each block in index order, only the non-empty rows
+//
+// Skipping empty rows is all the compression there is, but a sparse block
+// costs a few words and a dense one is a straight memcpy on load.
+
+struct CheckpointInfo {
+    uint64_t generation = 0;
+    Rule rule;
+    uint64_t population = 0;
+    // bounding box of the live cells, empty when max < min
+    int32_t min_x = 0, min_y = 0;
+    int32_t max_x = -1, max_y = -1;
+};
+
+// Writes to path + ".tmp" and renames over path, so a crash mid-write
+// leaves the last good checkpoint alone.
+bool write_checkpoint(const std::string &path, std::vector<CellBlock> &blocks,
+                      uint64_t generation, const Rule &rule,
+                      CheckpointInfo *info = nullptr);
+bool save_checkpoint(const std::string &path, const Engine &engine, uint64_t generation);
+
+// Clears the engine, loads the board and sets the saved rule.
+bool load_checkpoint(const std::string &path, Engine &engine, CheckpointInfo *info = nullptr);
+
+// Writes checkpoints on a background thread. submit() only takes the
+// engine's snapshot(), a copy of its tiles or its flat cell list; grouping
+// into blocks, sorting, packing and disk IO happen off the stepping thread.
+class CheckpointWriter {
+public:
+    explicit CheckpointWriter(const std::string &path);
+    ~CheckpointWriter();
+
+    CheckpointWriter(const CheckpointWriter &) = delete;
+    CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+
+    // false (and nothing copied) if the previous checkpoint is still being
+    // written, the caller just tries again later
+    bool submit(const Engine &engine, uint64_t generation);
+
+    // blocks until nothing is being written, returns whether the last
+    // write worked
+    bool wait();
+
+private:
+    void writer_loop();
+
+    std::string path;
+    std::thread writer;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable idle;
+
+    BoardSnapshot board, spare;
+    uint64_t generation = 0;
+    Rule rule;
+    bool pending = false;
+    bool stopping = false;
+    bool last_ok = true;
+};
+
+#endif // CHECKPOINT_HPP
@@ -0,0 +1,541 @@
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "checkpoint.hpp"
+#include "cycle.hpp"
+#include "engine.hpp"
+#include "game.hpp"
+#include "hashlife.hpp"
+#include "history.hpp"
+#include "rle.hpp"
+#include "shard.hpp"
+#include "tile_engine.hpp"
+
+// Checks for the features fast_life_bench --suite doesn't cover, one ctest
+// entry each: fast_life_checks <name>. Every check prints what went wrong
+// and exits non-zero on the first failure. Files go in the working
+// directory and are removed again.
+
+namespace {
+
+bool fail(const std::string &what) {
+    std::cerr << "FAIL: " << what << std::endl;
+    return false;
+}
+
+// A soup straddling the origin, so negative coordinates and the wrap get
+// exercised too
+Board soup(unsigned size, uint64_t seed) {
+    Board square, board;
+    initialize_from_random_soup(square, size, size, seed);
+    for (const Cell &c : square) board.insert({c.first - size / 2, c.second - size / 2});
+    return board;
+}
+
+Board gun() {
+    SetEngine loader(1);
+    std::string path = find_pattern_file("2c5-spaceship-gun-p416.txt");
+    if (path.empty() || !load_rle_file(path, loader, 1, 1)) return Board();
+    return loader.get_board();
+}
+
+// The same start stepped one generation at a time, the reference for every
+// engine that jumps or skips
+Board board_stepped(const Board &start, const Rule &rule, uint64_t generations) {
+    TileEngine engine;
+    engine.set_rule(rule);
+    engine.set_board(start);
+    for (uint64_t g = 0; g < generations; g++) engine.step();
+    return engine.get_board();
+}
+
+bool check_hashlife() {
+    const Board start = soup(160, 9);
+    for (const Rule &rule : {CONWAY, HIGHLIFE}) {
+        HashLife engine;
+        engine.set_rule(rule);
+        engine.set_board(start);
+        uint64_t generation = 0;
+        // odd sizes so every bit of advance() gets a turn
+        for (uint64_t n : {1, 6, 64, 93, 256}) {
+            engine.advance(n);
+            generation += n;
+            if (engine.get_board() != board_stepped(start, rule, generation)) {
+                return fail("advance(" + std::to_string(n) + ") to generation " +
+                            std::to_string(generation) + " under " + rule.str());
+            }
+        }
+    }
+
+    // a jump that outgrows a small store has to split rather than blow the cap
+    const size_t cap = (size_t)4 << 20;
+    HashLife capped(cap);
+    capped.set_board(soup(256, 1));
+    capped.advance(1 << 12);
+    if (capped.memory_used() > 3 * cap) {
+        return fail("a 4 MB store grew to " + std::to_string(capped.memory_used() >> 20) + " MB");
+    }
+    if (capped.get_board() != board_stepped(soup(256, 1), CONWAY, 1 << 12)) {
+        return fail("advance(4096) under a 4 MB cap");
+    }
+    return true;
+}
+
+// Blocks and blinkers on a grid that doesn't line up with the tiles, so
+// plenty of them straddle a tile edge, with gliders flying in from the
+// corner to wake still and period 2 tiles back up
+bool check_tiles() {
+    Board start;
+    for (int32_t gy = 0; gy < 14; gy++) {
+        for (int32_t gx = 0; gx < 14; gx++) {
+            int32_t x = gx * 21 - 150, y = gy * 21 - 150;
+            if ((gx + gy) % 2) {
+                start.insert({x, y});
+                start.insert({x + 1, y});
+                start.insert({x, y + 1});
+                start.insert({x + 1, y + 1});
+            } else {
+                start.insert({x, y});
+                start.insert({x + 1, y});
+                start.insert({x + 2, y});
+            }
+        }
+    }
+    for (int32_t g = 0; g < 3; g++) {
+        int32_t x = -230 - 40 * g, y = -200 - 35 * g;
+        for (const Cell &c : Board{{1, 0}, {2, 1}, {0, 2}, {1, 2}, {2, 2}}) {
+            start.insert({x + c.first, y + c.second});
+        }
+    }
+
+    TileEngine tiles;
+    SetEngine reference(1);
+    tiles.set_board(start);
+    reference.set_board(start);
+    bool skipped = false;
+    for (int g = 1; g <= 600; g++) {
+        tiles.step();
+        reference.step();
+        Board board = tiles.get_board();
+        if (board != reference.get_board()) {
+            return fail("tile engine differs from the set engine at generation " + std::to_string(g));
+        }
+
+        std::set<Cell> occupied;
+        for (const Cell &c : board) occupied.insert({c.first >> 6, c.second >> 6});
+        skipped = skipped || tiles.active_tiles() < occupied.size();
+    }
+    if (!skipped) return fail("no generation skipped a single settled tile");
+    return true;
+}
+
+bool check_rle() {
+    struct Case { const char *label; Board board; Rule rule; };
+    std::vector<Case> cases = {
+        {"gun", gun(), CONWAY},
+        {"soup", soup(200, 5), HIGHLIFE},
+        {"empty", Board(), DAY_AND_NIGHT},
+    };
+    if (cases[0].board.empty()) return fail("can't load the gun pattern");
+
+    const std::string path = "check_rle.rle";
+    for (const Case &c : cases) {
+        // both writers, and a load origin the Pos line has to override
+        for (int from_engine = 0; from_engine < 2; from_engine++) {
+            bool written;
+            if (from_engine) {
+                TileEngine engine;
+                engine.set_rule(c.rule);
+                engine.set_board(c.board);
+                written = write_rle_file(path, engine);
+            } else {
+                written = write_rle_file(path, c.board, c.rule.str());
+            }
+            if (!written) return fail(std::string("writing ") + c.label);
+
+            SetEngine loaded(1);
+            RleHeader header;
+            Rule rule;
+            if (!load_rle_file(path, loaded, 7, 9, &header)) return fail(std::string("reading ") + c.label);
+            if (!parse_rule(header.rule, rule) || rule != c.rule) {
+                return fail(std::string(c.label) + " came back with rule " + header.rule);
+            }
+            if (loaded.get_board() != c.board) {
+                return fail(std::string(c.label) + " came back different");
+            }
+        }
+    }
+
+    // the parser takes its input in any pieces, one byte at a time included
+    std::string text;
+    {
+        FILE *file = fopen(path.c_str(), "wb");
+        if (!file || !write_rle(file, cases[1].board, cases[1].rule.str())) return fail("write_rle");
+        fclose(file);
+        file = fopen(path.c_str(), "rb");
+        char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), file)) > 0) text.append(buf, n);
+        fclose(file);
+    }
+    Board pieces;
+    RleParser parser(0, 0, [&](unsigned x, unsigned y, unsigned length) {
+        for (unsigned i = 0; i < length; i++) pieces.insert({x + i, y});
+    });
+    for (size_t i = 0; i < text.size(); i++) parser.feed(&text[i], &text[i] + 1);
+    parser.flush();
+    remove(path.c_str());
+    if (!parser.finished() || pieces != cases[1].board) return fail("byte at a time parse differs");
+    return true;
+}
+
+bool check_checkpoint() {
+    const std::string path = "check_checkpoint.bin";
+    Board start = soup(128, 3);
+
+    for (const std::string &name : engine_names()) {
+        std::unique_ptr<Engine> engine = make_engine(name, 2);
+        engine->set_rule(HIGHLIFE);
+        engine->set_board(start);
+        engine->advance(40);
+        if (!save_checkpoint(path, *engine, 40)) return fail(name + ": writing the checkpoint");
+
+        // resume into every engine and carry on, they all have to end where
+        // an uninterrupted run does
+        Board expected = board_stepped(start, HIGHLIFE, 100);
+        for (const std::string &other : engine_names()) {
+            std::unique_ptr<Engine> resumed = make_engine(other, 2);
+            CheckpointInfo info;
+            if (!load_checkpoint(path, *resumed, &info)) return fail(other + ": reading the checkpoint");
+            if (info.generation != 40 || info.rule != HIGHLIFE ||
+                info.population != engine->population() || resumed->get_board() != engine->get_board()) {
+                return fail(name + " -> " + other + ": checkpoint doesn't match the board it saved");
+            }
+            resumed->advance(60);
+            if (resumed->get_board() != expected) {
+                return fail(name + " -> " + other + ": resumed run ends somewhere else");
+            }
+        }
+    }
+
+    // the background writer as well, from the tile engine's own blocks and
+    // from the others' flat cell lists
+    for (const std::string &name : engine_names()) {
+        std::unique_ptr<Engine> engine = make_engine(name, 2);
+        engine->set_board(start);
+        engine->advance(10);
+        {
+            CheckpointWriter writer(path);
+            if (!writer.submit(*engine, 10) || !writer.wait()) return fail(name + ": CheckpointWriter");
+        }
+        TileEngine resumed;
+        CheckpointInfo info;
+        if (!load_checkpoint(path, resumed, &info) || info.generation != 10 ||
+            resumed.get_board() != engine->get_board()) {
+            return fail(name + ": CheckpointWriter's checkpoint doesn't match");
+        }
+    }
+
+    // a damaged file is refused, not half loaded
+    FILE *file = fopen(path.c_str(), "r+b");
+    if (!file || fseek(file, -8, SEEK_END) != 0) return fail("truncating the checkpoint");
+    long size = ftell(file);
+    fclose(file);
+    if (truncate(path.c_str(), size) != 0) return fail("truncating the checkpoint");
+    TileEngine damaged;
+    bool loaded = load_checkpoint(path, damaged);
+    remove(path.c_str());
+    if (loaded) return fail("a truncated checkpoint loaded");
+    return true;
+}
+
+bool check_cycle() {
+    struct Case { const char *label; Board board; uint64_t period; int64_t dx, dy; };
+    std::vector<Case> cases = {
+        {"block", {{0, 0}, {1, 0}, {0, 1}, {1, 1}}, 1, 0, 0},
+        {"blinker", {{0, 1}, {1, 1}, {2, 1}}, 2, 0, 0},
+        {"glider", {{1, 0}, {2, 1}, {0, 2}, {1, 2}, {2, 2}}, 4, 1, 1},
+        {"glider going up left", {{1, 2}, {0, 1}, {2, 0}, {1, 0}, {0, 0}}, 4, -1, -1},
+    };
+
+    const uint64_t TARGET = 10007;
+    for (const Case &c : cases) {
+        Board expected = board_stepped(c.board, CONWAY, TARGET);
+        for (const std::string &name : engine_names()) {
+            std::unique_ptr<Engine> engine = make_engine(name, 1);
+            engine->set_board(c.board);
+            CycleDetector detector;
+            uint64_t generation = 0;
+            while (!detector.observe(*engine, generation) && generation < 200) {
+                engine->step();
+                generation++;
+            }
+
+            const Cycle &cycle = detector.cycle();
+            std::string label = std::string(c.label) + " on " + name;
+            if (!detector.confirmed()) return fail(label + ": no cycle found");
+            if (cycle.period != c.period || cycle.dx != c.dx || cycle.dy != c.dy) {
+                return fail(label + ": period " + std::to_string(cycle.period) + " moving (" +
+                            std::to_string(cycle.dx) + ", " + std::to_string(cycle.dy) + ")");
+            }
+
+            // skipping ahead lands on the same board as stepping there
+            fast_forward(*engine, cycle, generation, TARGET);
+            if (engine->get_board() != expected) {
+                return fail(label + ": fast_forward ends somewhere else");
+            }
+        }
+    }
+    return true;
+}
+
+// Boards of a few slabs each (a slab is 2^15 source cells), tall and wide,
+// one straddling the wrap between the top and bottom rows, which the sparse
+// engine has to take in one go
+bool check_sparse() {
+    struct Case { const char *label; unsigned width, height; int32_t x, y; };
+    const Case cases[] = {
+        {"tall", 420, 420, 5000, 70000},
+        {"wide", 6000, 30, -3000, -900},
+        {"across the wrap", 300, 300, -150, -150},
+    };
+
+    for (const Case &c : cases) {
+        Board square, start;
+        initialize_from_random_soup(square, c.width, c.height, 13);
+        for (const Cell &cell : square) start.insert({cell.first + c.x, cell.second + c.y});
+
+        std::unique_ptr<Engine> sparse = make_engine("sparse", 1);
+        TileEngine tiles;
+        sparse->set_board(start);
+        tiles.set_board(start);
+        for (int g = 1; g <= 40; g++) {
+            sparse->step();
+            tiles.step();
+            if (sparse->population() != tiles.population() || sparse->hash() != tiles.hash()) {
+                return fail(std::string(c.label) + ": sparse and tile engines differ at generation " +
+                            std::to_string(g));
+            }
+        }
+        if (sparse->get_board() != tiles.get_board()) {
+            return fail(std::string(c.label) + ": sparse and tile engines end on different boards");
+        }
+    }
+    return true;
+}
+
+bool check_shard() {
+    const std::string pattern = "check_shard_in.rle", save = "check_shard_out.rle";
+    Board start = soup(300, 11);
+    if (!write_rle_file(pattern, start)) return fail("writing the pattern");
+    Board expected = board_stepped(start, CONWAY, 120);
+
+    bool ok = true;
+    for (int shards : {2, 3, 5}) {
+        for (bool gather : {false, true}) {
+            std::string label = std::to_string(shards) + " shards" + (gather ? ", gathered" : "");
+            ShardOptions opts;
+            opts.shards = shards;
+            opts.rebalance_every = 4;
+            opts.gather = gather;
+            opts.save = save;
+            ShardResult result;
+            if (!run_sharded(pattern, 0, 0, "", 120, opts, result)) {
+                ok = fail(label + ": run failed");
+                break;
+            }
+
+            // every rank's file on top of each other, or the one gathered file
+            Board loaded;
+            auto add = [&](unsigned x, unsigned y, unsigned length) {
+                for (unsigned i = 0; i < length; i++) loaded.insert({x + i, y});
+            };
+            for (int r = 0; r < (gather ? 1 : shards); r++) {
+                std::string path = gather ? save : "check_shard_out." + std::to_string(r) + ".rle";
+                if (!parse_rle_file(path, 0, 0, add)) ok = fail(label + ": missing " + path);
+                remove(path.c_str());
+            }
+            if (ok && (loaded != expected || result.population != expected.size())) {
+                ok = fail(label + ": ends on a different board than one process");
+            }
+            if (!ok) break;
+        }
+        if (!ok) break;
+    }
+    remove(pattern.c_str());
+    if (!ok) return false;
+
+    // a frame length no shard would send is refused, not allocated
+    int left[2], right[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, left) != 0) return fail("socketpair");
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, right) != 0) return fail("socketpair");
+    uint64_t huge = (uint64_t)1 << 40;
+    if (write(right[1], &huge, sizeof(huge)) != sizeof(huge)) return fail("writing a frame length");
+    bool refused;
+    {
+        SocketTransport link(left[0], right[0]);
+        Message in;
+        refused = !link.recv_right(in);
+    }
+    close(left[1]);
+    close(right[1]);
+    if (!refused) return fail("a 1 TB frame length was accepted");
+    return true;
+}
+
+struct ViewBox { int32_t x0, y0, x1, y1; };
+
+Board in_box(const Board &board, const ViewBox &b) {
+    Board inside;
+    for (const Cell &c : board) {
+        int32_t x = c.first, y = c.second;
+        if (x >= b.x0 && x <= b.x1 && y >= b.y0 && y <= b.y1) inside.insert(c);
+    }
+    return inside;
+}
+
+bool check_history() {
+    const uint64_t GENERATIONS = 200;
+    Board start = soup(128, 7);
+
+    std::vector<Board> expected;
+    {
+        TileEngine engine;
+        engine.set_board(start);
+        for (uint64_t g = 0; g <= GENERATIONS; g++) {
+            expected.push_back(engine.get_board());
+            engine.step();
+        }
+    }
+
+    // forward one at a time, back in threes, then jumps across keyframes
+    std::vector<uint64_t> order;
+    for (uint64_t g = 0; g <= GENERATIONS; g++) order.push_back(g);
+    for (int64_t g = GENERATIONS; g >= 0; g -= 3) order.push_back(g);
+    for (uint64_t g : {5, 150, 17, 16, 15, 199, 0, 200}) order.push_back(g);
+
+    // one box across both axes, one off to the side
+    const ViewBox boxes[2] = {{-30, -40, 25, 10}, {10, 5, 60, 60}};
+
+    for (const std::string &name : engine_names()) {
+        std::unique_ptr<Engine> engine = make_engine(name, 2);
+        engine->set_board(start);
+        HistoryOptions opts;
+        opts.keyframe_every = 16;
+        opts.last_generation = GENERATIONS;
+        History history(*engine, 0, opts);
+        history.start();
+        history.set_playhead(GENERATIONS);
+        while (!history.finished()) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        if (history.oldest() != 0 || history.newest() != GENERATIONS) {
+            return fail(name + ": history doesn't cover the run");
+        }
+
+        HistoryCursor cursor(history), culled(history);
+        std::vector<Cell> cells;
+        size_t step = 0;
+        for (uint64_t g : order) {
+            std::string label = name + " generation " + std::to_string(g);
+            if (cursor.seek(g) != g) return fail(label + ": seek went elsewhere");
+            cursor.get_cells(cells);
+            if (Board(cells.begin(), cells.end()) != expected[g] || cells.size() != expected[g].size()) {
+                return fail(label + ": wrong cells");
+            }
+
+            // the box fetched from a full cursor
+            Board inside = in_box(expected[g], boxes[0]);
+            cursor.get_cells(cells, boxes[0].x0, boxes[0].y0, boxes[0].x1, boxes[0].y1);
+            if (Board(cells.begin(), cells.end()) != inside || cells.size() != inside.size()) {
+                return fail(label + ": wrong cells inside the box");
+            }
+
+            // and a cursor that only keeps its box, which moves now and then
+            const ViewBox &b = boxes[step++ / 7 % 2];
+            if (culled.seek(g, b.x0, b.y0, b.x1, b.y1) != g) return fail(label + ": culled seek went elsewhere");
+            culled.get_cells(cells);
+            inside = in_box(expected[g], b);
+            if (Board(cells.begin(), cells.end()) != inside || cells.size() != inside.size()) {
+                return fail(label + ": wrong cells in the culled cursor");
+            }
+            if (culled.population() != expected[g].size()) return fail(label + ": wrong population");
+        }
+    }
+
+    // A small budget with the playhead held back: the producer has to wait
+    // rather than drop what the playhead still needs, and the old groups go
+    // once the playhead has moved past them
+    std::unique_ptr<Engine> engine = make_engine("tile", 1);
+    engine->set_board(soup(256, 3));
+    HistoryOptions opts;
+    opts.keyframe_every = 16;
+    opts.memory_budget = (size_t)1 << 20;
+    History history(*engine, 0, opts);
+    history.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    if (history.oldest() != 0) {
+        return fail("budget dropped generation 0 from under the playhead, oldest is " +
+                    std::to_string(history.oldest()));
+    }
+    uint64_t held = history.newest();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    if (history.newest() != held) return fail("the producer kept going past the budget");
+
+    HistoryCursor cursor(history);
+    for (uint64_t playhead = 0; playhead <= 300; playhead++) {
+        history.set_playhead(playhead);
+        for (int wait = 0; history.newest() < playhead && wait < 2000; wait++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (history.oldest() > playhead) return fail("budget dropped the playhead's keyframe");
+        if (cursor.seek(playhead) != playhead) return fail("can't seek to the playhead " + std::to_string(playhead));
+    }
+    if (history.oldest() == 0) return fail("nothing was dropped once the playhead moved on");
+    history.stop();
+    return true;
+}
+
+struct Check {
+    const char *name;
+    std::function<bool()> run;
+};
+
+const std::vector<Check> CHECKS = {
+    {"hashlife", check_hashlife},
+    {"tiles", check_tiles},
+    {"rle", check_rle},
+    {"checkpoint", check_checkpoint},
+    {"cycle", check_cycle},
+    {"sparse", check_sparse},
+    {"shard", check_shard},
+    {"history", check_history},
+};
+
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " <check>, one of";
+        for (const Check &check : CHECKS) std::cerr << " " << check.name;
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    for (const Check &check : CHECKS) {
+        if (argv[1] != std::string(check.name)) continue;
+        if (!check.run()) return 1;
+        std::cout << check.name << " ok" << std::endl;
+        return 0;
+    }
+    std::cerr << "Unknown check: " << argv[1] << std::endl;
+    return 1;
+}
@@ -0,0 +1,122 @@
+#include <algorithm>
+
+#include "cycle.hpp"
+#include "cell_hash.hpp"
+#include "engine.hpp"
+
+// consecutive repeating generations needed before a cycle counts
+static const uint64_t MIN_CONFIRM = 2;
+static const uint64_t MAX_CONFIRM = 8;
+
+static uint64_t mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+CycleDetector::CycleDetector(size_t max_period)
+    : max_period(std::max<size_t>(max_period, 1)) {
+    reset();
+}
+
+void CycleDetector::reset() {
+    history.assign(max_period + 1, Entry{UINT64_MAX, 0, 0, 0, 0});
+    last_seen.clear();
+    candidate = Cycle();
+    found = Cycle();
+    matches = 0;
+}
+
+bool CycleDetector::observe(const Engine &engine, uint64_t generation) {
+    if(confirmed()) return true;
+
+    Entry e = {generation, 0, engine.population(), 0, 0};
+    int32_t max_x, max_y;
+    if(!engine.bounding_box(e.min_x, e.min_y, max_x, max_y)) {
+        e.min_x = e.min_y = 0;
+    }
+    e.shape = mix64(hash_translate(engine.hash(), -(int64_t)e.min_x, -(int64_t)e.min_y));
+
+    // drop whatever this slot held from the map before reusing it
+    Entry &slot = history[generation % history.size()];
+    if(slot.generation != UINT64_MAX) {
+        auto it = last_seen.find(slot.shape);
+        if(it != last_seen.end() && it->second == slot.generation) last_seen.erase(it);
+    }
+
+    auto it = last_seen.find(e.shape);
+    if(it != last_seen.end() && it->second < generation &&
+       generation - it->second <= max_period) {
+        const Entry &prev = history[it->second % history.size()];
+        if(prev.generation == it->second && prev.population == e.population) {
+            Cycle c;
+            c.period = generation - prev.generation;
+            c.dx = (int64_t)e.min_x - prev.min_x;
+            c.dy = (int64_t)e.min_y - prev.min_y;
+
+            bool same = matches > 0 && last_match + 1 == generation &&
+                        c.period == candidate.period && c.dx == candidate.dx &&
+                        c.dy == candidate.dy;
+            if(same) {
+                matches++;
+            } else {
+                candidate = c;
+                candidate.start = prev.generation;
+                matches = 1;
+            }
+            last_match = generation;
+
+            uint64_t needed = std::clamp(candidate.period, MIN_CONFIRM, MAX_CONFIRM);
+            if(matches >= needed) found = candidate;
+        }
+    }
+
+    slot = e;
+    last_seen[e.shape] = generation;
+    return confirmed();
+}
+
+void print_cycle(std::ostream &out, const Cycle &cycle) {
+    out << "cycle: period " << cycle.period;
+    if(cycle.dx || cycle.dy) {
+        out << ", moving (" << cycle.dx << ", " << cycle.dy << ") every period";
+    }
+    out << ", since generation " << cycle.start << std::endl;
+}
+
+void translate_engine(Engine &engine, int64_t dx, int64_t dy) {
+    if(dx == 0 && dy == 0) return;
+
+    std::vector<Cell> cells;
+    engine.get_cells(cells);
+
+    // keep rows together so runs stay runs
+    std::sort(cells.begin(), cells.end(), [](const Cell &a, const Cell &b) {
+        return a.second != b.second ? a.second < b.second : a.first < b.first;
+    });
+
+    engine.clear();
+    for(size_t i = 0; i < cells.size();) {
+        size_t j = i + 1;
+        while(j < cells.size() && cells[j].second == cells[i].second &&
+              cells[j].first == cells[j - 1].first + 1) {
+            j++;
+        }
+        engine.add_run(cells[i].first + (unsigned)dx, cells[i].second + (unsigned)dy, j - i);
+        i = j;
+    }
+    engine.commit();
+}
+
+uint64_t fast_forward(Engine &engine, const Cycle &cycle, uint64_t at, uint64_t target) {
+    if(target <= at || cycle.period == 0) return at;
+
+    uint64_t laps = (target - at) / cycle.period;
+    uint64_t phase = (target - at) % cycle.period;
+
+    engine.advance(phase);
+    // only the low 32 bits of the move matter, so let it wrap
+    translate_engine(engine, (int64_t)((uint64_t)cycle.dx * laps),
+                     (int64_t)((uint64_t)cycle.dy * laps));
+    return target;
+}
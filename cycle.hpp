@@ -0,0 +1,71 @@
+#ifndef CYCLE_HPP
+#define CYCLE_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+class Engine;
+
+// A board that repeats every `period` generations, moved by (dx, dy) each
+// time round. dx = dy = 0 is a still life (period 1) or oscillator.
+struct Cycle {
+    uint64_t start = 0; // earliest generation known to be in the cycle
+    uint64_t period = 0;
+    int64_t dx = 0, dy = 0;
+};
+
+enum CycleAction {
+    CYCLES_OFF,  // don't look
+    CYCLES_STOP, // stop the run once the board repeats
+    CYCLES_SKIP, // jump straight to the last generation
+};
+
+// Watches Engine::hash() taken relative to the bounding box, so spaceships
+// repeat as well as oscillators. A repeat has to hold for a few generations
+// in a row (the whole period for short ones) before it counts, which keeps
+// a stray hash collision from ending a run.
+class CycleDetector {
+public:
+    // periods up to max_period are found
+    explicit CycleDetector(size_t max_period = 1024);
+
+    // Call after every generation. Returns true once a cycle is confirmed,
+    // from then on cycle() describes it.
+    bool observe(const Engine &engine, uint64_t generation);
+
+    const Cycle &cycle() const { return found; }
+    bool confirmed() const { return found.period != 0; }
+    void reset();
+
+private:
+    struct Entry {
+        uint64_t generation;
+        uint64_t shape; // hash relative to the bounding box corner
+        size_t population;
+        int32_t min_x, min_y;
+    };
+
+    size_t max_period;
+    std::vector<Entry> history; // ring, history[generation % size]
+    std::unordered_map<uint64_t, uint64_t> last_seen; // shape -> generation
+
+    Cycle candidate;
+    uint64_t last_match = 0;
+    uint64_t matches = 0;
+    Cycle found;
+};
+
+// Takes an engine sitting at generation `at` inside cycle to generation
+// `target`: steps the leftover phase, then moves the board by the whole
+// periods it skipped. Returns target.
+uint64_t fast_forward(Engine &engine, const Cycle &cycle, uint64_t at, uint64_t target);
+
+// "period 2, moving (0, 0) every period, since generation 155"
+void print_cycle(std::ostream &out, const Cycle &cycle);
+
+// Moves every live cell by (dx, dy), wrapping like the Cell arithmetic
+void translate_engine(Engine &engine, int64_t dx, int64_t dy);
+
+#endif // CYCLE_HPP
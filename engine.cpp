@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#include "engine.hpp"
+#include "cell_hash.hpp"
+#include "tile_engine.hpp"
+#include "hashlife.hpp"
+#include "sparse_engine.hpp"
+#include "metrics.hpp"
+
+uint64_t Engine::hash() const {
+    std::vector<Cell> cells;
+    get_cells(cells);
+    return cells_hash(cells);
+}
+
+bool Engine::bounding_box(int32_t &min_x, int32_t &min_y,
+                          int32_t &max_x, int32_t &max_y) const {
+    std::vector<Cell> cells;
+    get_cells(cells);
+    if(cells.empty()) return false;
+
+    min_x = min_y = INT32_MAX;
+    max_x = max_y = INT32_MIN;
+    for(const Cell &c : cells) {
+        min_x = std::min(min_x, (int32_t)c.first);
+        max_x = std::max(max_x, (int32_t)c.first);
+        min_y = std::min(min_y, (int32_t)c.second);
+        max_y = std::max(max_y, (int32_t)c.second);
+    }
+    return true;
+}
+
+void BoardSnapshot::to_blocks() {
+    if(cells.empty()) return;
+
+    std::unordered_map<uint64_t, size_t> index;
+    for(const CellBlock &b : blocks) {
+        index.emplace(((uint64_t)(b.y0 >> 6) << 32) | (b.x0 >> 6), &b - blocks.data());
+    }
+    for(const Cell &c : cells) {
+        uint64_t key = ((uint64_t)(c.second >> 6) << 32) | (c.first >> 6);
+        auto [it, added] = index.try_emplace(key, blocks.size());
+        if(added) {
+            blocks.emplace_back();
+            CellBlock &b = blocks.back();
+            b.x0 = c.first & ~63u;
+            b.y0 = c.second & ~63u;
+            memset(b.rows, 0, sizeof(b.rows));
+        }
+        blocks[it->second].rows[c.second & 63] |= (uint64_t)1 << (c.first & 63);
+    }
+    cells.clear();
+}
+
+void Engine::get_blocks(std::vector<CellBlock> &blocks) const {
+    BoardSnapshot s;
+    get_cells(s.cells);
+    s.to_blocks();
+    blocks.swap(s.blocks);
+}
+
+void Engine::add_word(unsigned x, unsigned y, uint64_t bits) {
+    while(bits) {
+        unsigned start = __builtin_ctzll(bits);
+        uint64_t rest = ~(bits >> start);
+        unsigned length = rest ? __builtin_ctzll(rest) : 64 - start;
+
+        add_run(x + start, y, length);
+        bits &= length + start == 64 ? 0 : ~(uint64_t)0 << (start + length);
+    }
+}
+
+void Engine::add_block(const CellBlock &block) {
+    for(unsigned r = 0; r < 64; r++) {
+        if(block.rows[r]) add_word(block.x0, block.y0 + r, block.rows[r]);
+    }
+}
+
+SetEngine::SetEngine(int num_threads) : pool(num_threads) {}
+
+void SetEngine::set_board(const Board &b) {
+    board.reset();
+    board.bands[0] = b;
+    for(const Cell &c : b) {
+        board.min_y[0] = std::min(board.min_y[0], (int32_t)c.second);
+        board.max_y[0] = std::max(board.max_y[0], (int32_t)c.second);
+    }
+    hash_valid = false;
+    tracked = false;
+}
+
+void SetEngine::get_cells(std::vector<Cell> &cells) const {
+    cells.clear();
+    cells.reserve(board.size());
+    for(const Board &b : board.bands) cells.insert(cells.end(), b.begin(), b.end());
+}
+
+void SetEngine::add_run(unsigned x, unsigned y, unsigned length) {
+    // new cells can land outside the bands the last step left
+    board.collapse();
+    for(unsigned i = 0; i < length; i++) board.bands[0].insert({x + i, y});
+    if(length > 0) {
+        board.min_y[0] = std::min(board.min_y[0], (int32_t)y);
+        board.max_y[0] = std::max(board.max_y[0], (int32_t)y);
+    }
+    hash_valid = false;
+    tracked = false;
+}
+
+void SetEngine::step() {
+    METRICS_GENERATION(*this, 1);
+    threaded_get_next_board(board, next, pool, rule,
+                            hash_valid ? &hash_value : nullptr,
+                            tracking ? &changes : nullptr);
+    tracked = tracking;
+}
+
+bool SetEngine::get_changes(CellChanges &out) const {
+    out.clear();
+    if(!tracked) return false;
+    for(const CellChanges &c : changes) {
+        out.born.insert(out.born.end(), c.born.begin(), c.born.end());
+        out.died.insert(out.died.end(), c.died.begin(), c.died.end());
+    }
+    return true;
+}
+
+uint64_t SetEngine::hash() const {
+    if(!hash_valid) {
+        hash_value = 0;
+        for(const Board &b : board.bands) hash_value += board_hash(b);
+        hash_valid = true;
+    }
+    return hash_value;
+}
+
+const std::vector<std::string> &engine_names() {
+    static const std::vector<std::string> names = {"set", "tile", "hashlife", "sparse"};
+    return names;
+}
+
+std::unique_ptr<Engine> make_engine(const std::string &name, int num_threads) {
+    if(num_threads < 1) num_threads = 1;
+
+    if(name == "set") return std::make_unique<SetEngine>(num_threads);
+    if(name == "tile") return std::make_unique<TileEngine>();
+    if(name == "hashlife") return std::make_unique<HashLife>();
+    if(name == "sparse") return std::make_unique<SparseEngine>();
+    return nullptr;
+}
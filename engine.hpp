@@ -0,0 +1,145 @@
+#ifndef ENGINE_HPP
+#define ENGINE_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "game.hpp"
+#include "rule.hpp"
+#include "thread_pool.hpp"
+
+// A 64x64 block of the board, bit i of rows[r] is cell (x0 + i, y0 + r).
+// x0 and y0 are multiples of 64.
+struct CellBlock {
+    uint32_t x0, y0;
+    uint64_t rows[64];
+};
+
+// The board copied out of an engine in whatever form is cheapest to copy,
+// for work that carries on on another thread. Engines with 64x64 storage
+// fill blocks directly, the rest hand over a flat cell list and
+// to_blocks() does the grouping later.
+struct BoardSnapshot {
+    std::vector<CellBlock> blocks;
+    std::vector<Cell> cells;
+
+    // groups cells into blocks and empties cells (keeping its capacity)
+    void to_blocks();
+};
+
+// Everything that can step a board implements this, so the drivers
+// can pick a backend at runtime instead of calling
+// threaded_get_next_board directly.
+class Engine {
+public:
+    virtual ~Engine() = default;
+
+    virtual const char *name() const = 0;
+
+    virtual void set_board(const Board &board) = 0;
+    virtual Board get_board() const = 0;
+
+    // Flat copy of the live cells in no particular order, much cheaper than
+    // get_board() for renderers that just need to walk them.
+    virtual void get_cells(std::vector<Cell> &cells) const {
+        Board board = get_board();
+        cells.assign(board.begin(), board.end());
+    }
+
+    // Positional hash of the live cells, see cell_hash.hpp. Engines keep
+    // it up to date from births and deaths once it has been asked for,
+    // this default just recomputes it.
+    virtual uint64_t hash() const;
+
+    // Bounding box of the live cells, read as signed coordinates. False
+    // when the board is empty.
+    virtual bool bounding_box(int32_t &min_x, int32_t &min_y,
+                              int32_t &max_x, int32_t &max_y) const;
+
+    // The board as 64x64 bitmaps, for checkpoints. Blocks come in no
+    // particular order and may be empty.
+    virtual void get_blocks(std::vector<CellBlock> &blocks) const;
+    // Flat cells by default, no hashing on the caller's thread
+    virtual void snapshot(BoardSnapshot &s) const {
+        s.blocks.clear();
+        get_cells(s.cells);
+    }
+
+    // Bulk loading without building a Board first: clear(), add_run() for
+    // every horizontal run of live cells, then commit().
+    virtual void clear() = 0;
+    virtual void add_run(unsigned x, unsigned y, unsigned length) = 0;
+    // bit i of bits is cell (x + i, y), split into runs unless overridden
+    virtual void add_word(unsigned x, unsigned y, uint64_t bits);
+    virtual void add_block(const CellBlock &block);
+    virtual void commit() {}
+
+    // advance one generation
+    virtual void step() = 0;
+    // Any number of generations. Engines that can jump ahead (HashLife)
+    // override this, everything else just steps.
+    virtual void advance(uint64_t generations) {
+        for(uint64_t i = 0; i < generations; i++) step();
+    }
+    virtual size_t population() const = 0;
+
+    // Births and deaths of the last step(), for callers that follow a run
+    // generation by generation. Engines that can hand these over cheaply
+    // start keeping them once track_changes() is called. False when this
+    // one can't, or didn't keep them that step; diff get_cells() then.
+    virtual void track_changes() {}
+    virtual bool get_changes(CellChanges &) const { return false; }
+
+    // How many tiles/chunks the last step had to recompute, for engines
+    // that skip settled regions. 0 means the engine doesn't track it.
+    virtual size_t active_tiles() const { return 0; }
+
+    virtual void set_rule(const Rule &r) { rule = r; }
+    const Rule &get_rule() const { return rule; }
+
+protected:
+    Rule rule = CONWAY;
+};
+
+// The original std::set path, one generation per threaded_get_next_board
+class SetEngine : public Engine {
+public:
+    explicit SetEngine(int num_threads);
+
+    const char *name() const override { return "set"; }
+
+    void set_board(const Board &b) override;
+    Board get_board() const override { return board.joined(); }
+    void get_cells(std::vector<Cell> &cells) const override;
+    bool bounding_box(int32_t &min_x, int32_t &min_y,
+                      int32_t &max_x, int32_t &max_y) const override {
+        return board.bounding_box(min_x, min_y, max_x, max_y);
+    }
+
+    void clear() override { board.reset(); hash_valid = false; tracked = false; }
+    void add_run(unsigned x, unsigned y, unsigned length) override;
+
+    void step() override;
+    size_t population() const override { return board.size(); }
+    uint64_t hash() const override;
+
+    void track_changes() override { tracking = true; }
+    bool get_changes(CellChanges &changes) const override;
+
+private:
+    // next only holds empty bands between steps
+    BandedBoard board, next;
+    // per band, from the last step when it was tracked
+    std::vector<CellChanges> changes;
+    bool tracking = false, tracked = false;
+    mutable uint64_t hash_value = 0;
+    mutable bool hash_valid = false;
+    ThreadPool pool;
+};
+
+// "set", "tile", "hashlife" or "sparse", returns nullptr for anything else
+std::unique_ptr<Engine> make_engine(const std::string &name, int num_threads);
+const std::vector<std::string> &engine_names();
+
+#endif // ENGINE_HPP
@@ -1,22 +1,20 @@
+#include <algorithm>
 #include <array>
 #include <stdlib.h>
 #include <iostream>
-#include <sstream>
 #include <utility>
 #include <set>
 #include <thread>
 #include <fstream>
+#include <cstring>
 
-#include "gl_utils.hpp"
 #include "game.hpp"
-
-void clearScreen() {
-#ifdef _WIN32
-    system("cls");
-#else
-    system("clear");
-#endif
-}
+#include "cell_hash.hpp"
+#include "engine.hpp"
+#include "rle.hpp"
+#include "thread_pool.hpp"
+#include "xoshiro.hpp"
+#include "metrics.hpp"
 
 void initialize_from_random_soup(
         Board &board, unsigned int width, unsigned int height) {
@@ -30,185 +28,279 @@ void initialize_from_random_soup(
     }
 }
 
-void initialize_from_RLE(Board& board, const std::string& rle,
-                                            int startX, int startY) {
-    board = {};
-
-    int x = startX, y = startY;
-    std::istringstream rleStream(rle);
-    char ch;
+void initialize_from_random_soup(
+        Board &board, unsigned int width, unsigned int height, uint64_t seed) {
 
-    while (rleStream.get(ch)) {
-        std::string countStr;
+    // row-major words, same draw order as load_soup in census.cpp
+    unsigned words = (width + 63) / 64;
+    std::vector<uint64_t> rows((size_t)words * height);
+    Xoshiro256 rng(seed);
+    for(uint64_t &w : rows) w = rng.next();
 
-        // Accumulate digits to form the count number
-        while (std::isdigit(ch)) {
-            countStr.push_back(ch);
-            if (!rleStream.get(ch)) {
-                break;
-            }
-        }
-
-        int count = countStr.empty() ? 1 : std::stoi(countStr);
-
-        switch (ch) {
-            case 'b': // Dead cell
-            case '.':
-                x += count;
-                break;
-            case 'o': // Alive cell
-                for (int i = 0; i < count; ++i, ++x) {
-                    board.insert({x, y});
-                }
-                break;
-            case '$': // End of line
-                y += count;
-                x = startX;
-                break;
+    board = {};
+    // column by column, so every insert lands at the end of the tree
+    for(unsigned x = 0; x < width; x++){
+        for(unsigned y = 0; y < height; y++){
+            if((rows[(size_t)y * words + x / 64] >> (x % 64)) & 1)
+                board.insert(board.end(), {x, y});
         }
     }
 }
 
-Board get_neighbours(Cell c) {
-    Board neighbours;
-    for(int dx = -1; dx <= 1; dx++){
-        for(int dy = -1; dy <= 1; dy++){
-            if(dx == 0 && dy == 0) continue;
-            neighbours.insert({c.first + dx, c.second + dy});
-        }
-    }
+// Tries the name as given, then the bundled rle_files directory, then the
+// old ../rle_files/ spot relative to a build directory.
+std::string find_pattern_file(const std::string &name) {
+    std::vector<std::string> paths = {name};
+#ifdef FAST_LIFE_RLE_DIR
+    paths.push_back(std::string(FAST_LIFE_RLE_DIR) + "/" + name);
+#endif
+    paths.push_back("../rle_files/" + name);
 
-    return neighbours;
+    for(const std::string &path : paths){
+        if(std::ifstream(path).is_open()) return path;
+    }
+    return "";
 }
 
-void update_section(const Board &b, Board &slice,
-        size_t start_row, size_t end_row ) {
-
-    Board candidates;
-
-    auto it = b.begin();
-    std::advance(it, start_row);
+void initialize_from_RLE(Board& board, const std::string& rle,
+                                            int startX, int startY) {
+    board = {};
 
-    // slice candidates by index
-    for(size_t i = start_row; i < end_row && it != b.end(); i++, it++){
-        candidates.insert(*it);
-    }
+    RleParser parser(startX, startY, [&](unsigned x, unsigned y, unsigned n) {
+        for (unsigned i = 0; i < n; i++) board.insert({x + i, y});
+    });
+    parser.feed(rle.data(), rle.data() + rle.size());
+    parser.flush();
+}
 
-    Board c_neighbours;
-    for(const Cell &c : candidates) {
-        Board neighbours = get_neighbours(c);
-        c_neighbours.insert(neighbours.begin(), neighbours.end());
+uint64_t board_hash(const Board &board) {
+    uint64_t h = 0;
+    for(const Cell &c : board){
+        h += cell_hash((int32_t)c.first, (int32_t)c.second);
     }
-    candidates.insert(c_neighbours.begin(), c_neighbours.end());
-
-    for(const Cell &c : candidates){
-        int n_count = 0;
-
-        for(const Cell &n : get_neighbours(c)){
-            if(b.count(n)) n_count ++;
-        }
+    return h;
+}
 
-        bool alive = b.count(c);
-        if(alive && (n_count == 2 || n_count == 3)) slice.insert(c);
-        else if(!alive && n_count == 3) slice.insert(c);
-    }
+void BandedBoard::reset() {
+    bands.assign(1, Board());
+    starts.assign(1, 0);
+    last = ((int64_t)1 << 32) - 1;
+    min_y.assign(1, INT32_MAX);
+    max_y.assign(1, INT32_MIN);
 }
 
-void threaded_get_next_board(
-        Board &board,
-        std::vector<std::thread> &threads,
-        int num_threads,
-        std::vector<Board> &slices){
+void BandedBoard::collapse() {
+    if(bands.size() == 1 && starts[0] == 0 && last == ((int64_t)1 << 32) - 1) return;
+
+    Board all;
+    for(Board &b : bands) all.merge(b);
+    int32_t lo = *std::min_element(min_y.begin(), min_y.end());
+    int32_t hi = *std::max_element(max_y.begin(), max_y.end());
+    reset();
+    bands[0] = std::move(all);
+    min_y[0] = lo;
+    max_y[0] = hi;
+}
 
-    int rows_per_thread = board.size() / num_threads;
+Board BandedBoard::joined() const {
+    Board all;
+    for(const Board &b : bands) all.insert(b.begin(), b.end());
+    return all;
+}
 
-    Board next_board;
+size_t BandedBoard::size() const {
+    size_t n = 0;
+    for(const Board &b : bands) n += b.size();
+    return n;
+}
 
+bool BandedBoard::bounding_box(int32_t &min_x_out, int32_t &min_y_out,
+                               int32_t &max_x_out, int32_t &max_y_out) const {
+    min_x_out = min_y_out = INT32_MAX;
+    max_x_out = max_y_out = INT32_MIN;
+    bool any = false;
+    for(size_t i = 0; i < bands.size(); i++){
+        const Board &b = bands[i];
+        if(b.empty()) continue;
+        any = true;
+
+        // negative columns sort after the rest when read unsigned
+        auto negative = b.lower_bound({0x80000000u, 0});
+        unsigned lo = negative != b.end() ? negative->first : b.begin()->first;
+        unsigned hi = negative != b.begin() ? std::prev(negative)->first : b.rbegin()->first;
+        min_x_out = std::min(min_x_out, (int32_t)lo);
+        max_x_out = std::max(max_x_out, (int32_t)hi);
+        min_y_out = std::min(min_y_out, min_y[i]);
+        max_y_out = std::max(max_y_out, max_y[i]);
+    }
+    return any;
+}
 
-    for(int i = 0; i < num_threads; i++){
-        int start_row = i * rows_per_thread;
-        int end_row = (i + 1) * rows_per_thread;
+int BandedBoard::band_of(unsigned x) const {
+    // the bands span at most 2^32 columns, so x turns up once at most
+    const int64_t wrap = (int64_t)1 << 32;
+    int64_t u = x;
+    if(u > last) u -= wrap;
+    else if(u < starts[0]) u += wrap;
+    if(u < starts[0] || u > last) return -1;
+    return (int)(std::upper_bound(starts.begin(), starts.end(), u) - starts.begin()) - 1;
+}
 
-        if(i == num_threads - 1){
-            end_row = board.size() - 1;
+int count_neighbours(const BandedBoard &b, Cell c) {
+    int n_count = 0;
+    for(int dx = -1; dx <= 1; dx++){
+        for(int dy = -1; dy <= 1; dy++){
+            if(dx == 0 && dy == 0) continue;
+            if(b.contains({c.first + dx, c.second + dy})) n_count++;
         }
-        slices[i] = {};
-        threads[i] = std::thread(update_section,
-                std::ref(board),
-                std::ref(slices[i]),
-                start_row, end_row);
-    }
-
-    for(auto &t : threads){
-        t.join();
     }
+    return n_count;
+}
 
-    for(const Board &slice : slices){
-        next_board.insert(slice.begin(), slice.end());
+// Visits live cells with a column in [first_col, last_col]. The range is in
+// unwrapped coordinates so it can hang off either end of the unsigned range
+// by a column or two, those bits get looked up on the other side.
+template <typename F>
+void for_each_in_columns(const Board &b, int64_t first_col, int64_t last_col,
+                                                                F visit) {
+    const int64_t wrap = (int64_t)1 << 32;
+    int64_t lo = first_col;
+    while(lo <= last_col){
+        int64_t k = lo >= 0 ? lo / wrap : -((-lo + wrap - 1) / wrap);
+        int64_t hi = std::min(last_col, (k + 1) * wrap - 1);
+
+        auto it = b.lower_bound({(unsigned)(lo - k * wrap), 0});
+        for(; it != b.end() && it->first <= hi - k * wrap; it++){
+            visit(*it);
+        }
+        lo = hi + 1;
     }
-
-    board = std::move(next_board);
 }
 
-void print_to_term(Board &board, const int iterations, const bool print) {
-
-    int i = 0;
-
-    int num_threads = std::thread::hardware_concurrency();
-    std::vector<std::thread> threads(num_threads);
-    std::vector<Board> slices(num_threads);
-
-    while(i < iterations){
-        if(print) {
-            std::stringstream buffer;
+// Computes the next state of every cell whose column is in
+// [first_col, last_col]. Reads a one column halo either side, but only
+// ever writes cells it owns, so neighbouring bands never redo each other.
+void update_section(const BandedBoard &b, Board &slice,
+        int64_t first_col, int64_t last_col, const Rule &rule,
+        uint64_t *hash_delta, std::pair<int32_t, int32_t> *rows,
+        CellChanges *changes) {
+
+    unsigned base = (unsigned)first_col;
+    unsigned width = (unsigned)(last_col - first_col);
+
+    METRICS_BEGIN(PHASE_CANDIDATES);
+    std::vector<Cell> candidates;
+    auto add_candidates = [&](const Cell &c){
+        for(int dx = -1; dx <= 1; dx++){
+            unsigned x = c.first + dx;
+            if((unsigned)(x - base) > width) continue;
+
+            for(int dy = -1; dy <= 1; dy++){
+                candidates.push_back({x, c.second + dy});
+            }
+        }
+    };
+    for(const Board &band : b.bands){
+        for_each_in_columns(band, first_col - 1, last_col + 1, add_candidates);
+    }
 
-            buffer << "\033[2J\033[H";
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                     candidates.end());
+    METRICS_END(PHASE_CANDIDATES);
+    METRICS_COUNT(COUNTER_CANDIDATES, candidates.size());
 
-            for (const Cell& cell : board) {
-                unsigned int r = cell.first, c = cell.second;
-                buffer << "\033[" << r + 1 << ";" << c + 1 << "H";
-                buffer << "□";
+    METRICS_BEGIN(PHASE_COMPUTE);
+    uint64_t delta = 0;
+    for(const Cell &c : candidates){
+        int n_count = count_neighbours(b, c);
+        bool alive = b.contains(c);
+        bool next = rule.next(alive, n_count);
+
+        if(next){
+            slice.insert(slice.end(), c);
+            if(rows){
+                rows->first = std::min(rows->first, (int32_t)c.second);
+                rows->second = std::max(rows->second, (int32_t)c.second);
             }
-
-            // Print the entire buffer to std::cout in one go
-            clearScreen();
-            std::cout << buffer.str();
-            std::cout.flush();
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
         }
-
-        threaded_get_next_board(board, threads, num_threads, slices);
-        i++;
+        if(hash_delta && next != alive){
+            uint64_t key = cell_hash((int32_t)c.first, (int32_t)c.second);
+            delta += next ? key : -key;
+        }
+        if(changes && next != alive){
+            (next ? changes->born : changes->died).push_back(c);
+        }
     }
+    if(hash_delta) *hash_delta += delta;
+    METRICS_END(PHASE_COMPUTE);
 }
 
-int main(int argc, char** argv) {
-    std::string RLE_file = "2c5-spaceship-gun-p416.txt";
-    //std::string RLE_file = "smaller-ship.txt";
-    //std::string RLE_file = "oscillator.txt";
-    //std::string RLE_file = "queen_bee.txt";
-
-    std::ifstream file("../rle_files/" + RLE_file);
-
-    if (!file.is_open()) {
-        std::cerr << "Error opening file: " << RLE_file << std::endl;
-        return 1;
+void threaded_get_next_board(
+        BandedBoard &board,
+        BandedBoard &next,
+        ThreadPool &pool,
+        const Rule &rule,
+        uint64_t *hash,
+        std::vector<CellChanges> *changes){
+
+    // Each band is in column order on its own, so the live columns come
+    // from their ends
+    bool any = false;
+    unsigned min_x = 0, max_x = 0;
+    for(const Board &b : board.bands){
+        if(b.empty()) continue;
+        min_x = any ? std::min(min_x, b.begin()->first) : b.begin()->first;
+        max_x = any ? std::max(max_x, b.rbegin()->first) : b.rbegin()->first;
+        any = true;
+    }
+    if(changes) changes->clear();
+    if(!any) return;
+
+    // Column bands over the live area plus the ring that can be born.
+    // More bands than workers so stealing can even out dense regions.
+    const int64_t wrap = (int64_t)1 << 32;
+    int64_t first_col = (int64_t)min_x - 1;
+    int64_t last_col = (int64_t)max_x + 1;
+    if(last_col - first_col + 1 > wrap){
+        first_col = 0;
+        last_col = wrap - 1;
     }
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-
-    file.close();
-
-    std::string contents = buffer.str();
-    const char* RLE = contents.c_str();
-
-    Board board = {};
-    unsigned int board_height = board.size() + 2;
-    unsigned int board_width = board.size() + 2;
-    initialize_from_RLE(board, RLE, board_width/2, board_height/2);
-
-    init_window(argc,  argv, board);
-    return 0;
+    int64_t span = last_col - first_col + 1;
+    size_t num_bands = std::min<int64_t>(span, pool.size() * BANDS_PER_THREAD);
+    next.bands.resize(num_bands);
+    next.starts.resize(num_bands);
+    next.min_y.resize(num_bands);
+    next.max_y.resize(num_bands);
+    next.last = last_col;
+    for(size_t i = 0; i < num_bands; i++){
+        next.starts[i] = first_col + span * i / num_bands;
+    }
+    std::vector<uint64_t> hash_deltas(hash ? num_bands : 0, 0);
+    if(changes) changes->resize(num_bands);
+
+    METRICS_BEGIN(PHASE_PARALLEL);
+    pool.parallel_for(num_bands, [&](size_t i, int){
+        int64_t hi = i + 1 < num_bands ? next.starts[i + 1] - 1 : last_col;
+
+        std::pair<int32_t, int32_t> rows = {INT32_MAX, INT32_MIN};
+        next.bands[i].clear();
+        update_section(board, next.bands[i], next.starts[i], hi, rule,
+                       hash ? &hash_deltas[i] : nullptr, &rows,
+                       changes ? &(*changes)[i] : nullptr);
+        next.min_y[i] = rows.first;
+        next.max_y[i] = rows.second;
+    });
+    for(uint64_t d : hash_deltas) *hash += d;
+    METRICS_END(PHASE_PARALLEL);
+
+    // The new bands are the board now. Freeing the old ones is the only
+    // thing left, and that gets spread over the pool as well.
+    METRICS_BEGIN(PHASE_MERGE);
+    pool.parallel_for(board.bands.size(), [&](size_t i, int){
+        board.bands[i].clear();
+    });
+    std::swap(board, next);
+    METRICS_END(PHASE_MERGE);
 }
-
@@ -1,15 +1,93 @@
 #ifndef GAME_HPP
 #define GAME_HPP
 
+#include <cstdint>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rule.hpp"
+
+class Engine;
+class ThreadPool;
+
 typedef std::pair<unsigned int, unsigned int> Cell;
 typedef std::set<Cell> Board;
 
-void threaded_get_next_board(Board &board,
-        std::vector<std::thread> &threads,
-        int num_threads,
-        std::vector<Board> &slices);
+// What one step did, in no particular order
+struct CellChanges {
+    std::vector<Cell> born, died;
+
+    void clear() { born.clear(); died.clear(); }
+};
+
+// column bands handed out per pool worker each generation
+const int BANDS_PER_THREAD = 4;
+
+// The set path's board, kept as the column bands the last step wrote. The
+// next step reads them where they are, so they never get joined back into
+// one set. Band i holds the columns [starts[i], starts[i + 1]), the last
+// one up to `last`, unwrapped the same way the step picks them.
+struct BandedBoard {
+    std::vector<Board> bands;
+    std::vector<int64_t> starts;
+    int64_t last;
+    // signed row range of each band, INT32_MAX/INT32_MIN when it's empty
+    std::vector<int32_t> min_y, max_y;
+
+    BandedBoard() { reset(); }
+
+    // one empty band over every column
+    void reset();
+    // everything into bands[0], over every column again
+    void collapse();
+    Board joined() const;
+
+    size_t size() const;
+    // Engine::bounding_box, from the ends of each band and its row range
+    bool bounding_box(int32_t &min_x, int32_t &min_y,
+                      int32_t &max_x, int32_t &max_y) const;
+    // -1 for a column outside every band
+    int band_of(unsigned x) const;
+    bool contains(const Cell &c) const {
+        int i = band_of(c.first);
+        return i >= 0 && bands[i].count(c);
+    }
+};
+
+void initialize_from_random_soup(
+        Board &board, unsigned int width, unsigned int height);
+// Same 50% soup from its own generator, so seeds are reproducible across
+// threads and platforms
+void initialize_from_random_soup(
+        Board &board, unsigned int width, unsigned int height, uint64_t seed);
+void initialize_from_RLE(Board& board, const std::string& rle,
+                                            int startX, int startY);
+std::string find_pattern_file(const std::string &name);
+
+// Order independent, so boards from different engines can be compared.
+// Same value as Engine::hash(), see cell_hash.hpp.
+uint64_t board_hash(const Board &board);
+
+// Steps board into next's bands and swaps them. With hash set, *hash is
+// moved along by the births and deaths. With changes set, it ends up with
+// one entry per band holding that band's births and deaths.
+void threaded_get_next_board(BandedBoard &board,
+        BandedBoard &next,
+        ThreadPool &pool,
+        const Rule &rule = CONWAY,
+        uint64_t *hash = nullptr,
+        std::vector<CellChanges> *changes = nullptr);
 
-void update_section(const Board &b, Board &slice,
-                        size_t start_row, size_t end_row );
+// With rows set, widens rows->first/second (signed min/max y) to every
+// cell written into slice. With changes set, appends the cells that
+// flipped.
+void update_section(const BandedBoard &b, Board &slice,
+                        int64_t first_col, int64_t last_col,
+                        const Rule &rule = CONWAY,
+                        uint64_t *hash_delta = nullptr,
+                        std::pair<int32_t, int32_t> *rows = nullptr,
+                        CellChanges *changes = nullptr);
 
 #endif // GAME_HPP
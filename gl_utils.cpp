@@ -1,65 +1,190 @@
 #define GL_SILENCE_DEPRECATION
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
-#include <thread>
-#include <set>
 
 #include "gl_utils.hpp"
+#include "history.hpp"
 
-float zoomScale = 1.0f;
-float centerX = 0.0f;
+// The engine lives on History's producer thread, which computes ahead of
+// what's on screen and records it. The GLUT callbacks only move a playhead
+// through the recording, so a slow step can't stall a frame, the frame rate
+// doesn't cap the step rate and stepping backward costs no recomputation.
+
+float zoomScale = 1.0f; // cells per screen pixel
+float centerX = 0.0f;   // view centre, in cells
 float centerY = 0.0f;
 
-Board global_board = {};
+const int FRAME_MS = 16;
+const uint64_t JUMP_GENERATIONS = 100;
 
-int num_threads = std::thread::hardware_concurrency();
-std::vector<std::thread> threads(num_threads);
-std::vector<Board> slices(num_threads);
+std::unique_ptr<Engine> global_engine;
+std::unique_ptr<History> history;
+std::unique_ptr<HistoryCursor> cursor;
+std::vector<Cell> frame_cells;
 
-void update_global_board() {
-    threaded_get_next_board(global_board, threads, num_threads, slices);
-    glutPostRedisplay();
+// playback, only touched from GLUT callbacks
+double playhead = 0;
+bool paused = false;
+int direction = 1;
+double target_gps = 60.0; // 0 means as fast as it goes
+std::chrono::steady_clock::time_point last_advance;
+
+void stop_simulation() {
+    if (history) history->stop();
+}
+
+// Moves the playhead on by the time since the last frame, clamped to what's
+// recorded. Unlimited speed just follows the producer.
+void advance_playhead() {
+    auto now = std::chrono::steady_clock::now();
+    double dt = std::chrono::duration<double>(now - last_advance).count();
+    last_advance = now;
+
+    double oldest = (double)history->oldest(), newest = (double)history->newest();
+    if (!paused) {
+        if (target_gps <= 0) playhead = direction > 0 ? newest : oldest;
+        else playhead += direction * target_gps * dt;
+    }
+    playhead = std::clamp(playhead, oldest, newest);
+    history->set_playhead((uint64_t)playhead);
 }
 
-void set_pixel(int x, int y, float r, float g, float b) {
-    glColor3f(r, g, b);
-    glBegin(GL_POINTS);
-    glVertex2i(x, y);
+void jump(double generations) {
+    paused = true;
+    playhead = std::clamp(std::floor(playhead) + generations,
+                          (double)history->oldest(), (double)history->newest());
+}
+
+// Rasterises the visible part of the board into one texture. Zoomed in,
+// a texel is a cell and GL scales it up. Zoomed out, a texel is a screen
+// pixel and its brightness is how many cells landed in it.
+GLuint board_texture = 0;
+int texture_w = 0, texture_h = 0;
+std::vector<uint16_t> texel_counts;
+std::vector<uint8_t> texels;
+
+void draw_cells(const std::vector<Cell> &cells, int width, int height) {
+    double left = centerX - width / 2.0 * zoomScale;
+    double top = centerY - height / 2.0 * zoomScale;
+
+    double cells_per_texel = std::max(1.0, (double)zoomScale);
+    double grid_x = left, grid_y = top;
+    int grid_w = width, grid_h = height;
+    if (zoomScale < 1.0f) {
+        grid_x = std::floor(left);
+        grid_y = std::floor(top);
+        grid_w = (int)std::ceil(width * zoomScale) + 1;
+        grid_h = (int)std::ceil(height * zoomScale) + 1;
+    }
+
+    texel_counts.assign((size_t)grid_w * grid_h, 0);
+    double inv = 1.0 / cells_per_texel;
+    for (const Cell &cell : cells) {
+        double tx = ((int32_t)cell.first - grid_x) * inv;
+        double ty = ((int32_t)cell.second - grid_y) * inv;
+        if (tx < 0 || ty < 0 || tx >= grid_w || ty >= grid_h) continue;
+
+        uint16_t &count = texel_counts[(size_t)ty * grid_w + (size_t)tx];
+        if (count < UINT16_MAX) count++;
+    }
+
+    double full = cells_per_texel * cells_per_texel;
+    texels.resize(texel_counts.size());
+    for (size_t i = 0; i < texels.size(); i++) {
+        uint16_t count = texel_counts[i];
+        texels[i] = count == 0 ? 0 : (uint8_t)std::min(255.0, 96 + 159 * count / full);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, board_texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (grid_w != texture_w || grid_h != texture_h) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, grid_w, grid_h, 0,
+                     GL_LUMINANCE, GL_UNSIGNED_BYTE, texels.data());
+        texture_w = grid_w;
+        texture_h = grid_h;
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, grid_w, grid_h,
+                        GL_LUMINANCE, GL_UNSIGNED_BYTE, texels.data());
+    }
+
+    // where the texel grid sits in window pixels
+    double px0 = (grid_x - left) / zoomScale;
+    double py0 = (grid_y - top) / zoomScale;
+    double px1 = px0 + grid_w * cells_per_texel / zoomScale;
+    double py1 = py0 + grid_h * cells_per_texel / zoomScale;
+
+    glEnable(GL_TEXTURE_2D);
+    glColor3f(1.0, 0.0, 0.0); // Red
+    glBegin(GL_QUADS);
+    glTexCoord2f(0, 0); glVertex2d(px0, py0);
+    glTexCoord2f(1, 0); glVertex2d(px1, py0);
+    glTexCoord2f(1, 1); glVertex2d(px1, py1);
+    glTexCoord2f(0, 1); glVertex2d(px0, py1);
     glEnd();
+    glDisable(GL_TEXTURE_2D);
+}
+
+void update_title() {
+    static auto last = std::chrono::steady_clock::now();
+    auto now = std::chrono::steady_clock::now();
+    if (now - last < std::chrono::milliseconds(250)) return;
+    last = now;
+
+    char title[192];
+    std::string speed = paused ? "paused" : target_gps > 0 ? std::to_string((int)target_gps) + " gen/s"
+                                                           : "unlimited";
+    snprintf(title, sizeof(title), "fast_life  gen %llu  pop %zu  %s%s  [%llu..%llu]",
+             (unsigned long long)cursor->generation(), cursor->population(), speed.c_str(),
+             direction < 0 && !paused ? " reverse" : "",
+             (unsigned long long)history->oldest(), (unsigned long long)history->newest());
+    glutSetWindowTitle(title);
+}
+
+// Cells under the window, as a box draw_cells can take from the cursor
+void visible_cells(int width, int height, int32_t &min_x, int32_t &min_y,
+                   int32_t &max_x, int32_t &max_y) {
+    auto clamp_cell = [](double v) {
+        return (int32_t)std::clamp(v, (double)INT32_MIN, (double)INT32_MAX);
+    };
+    min_x = clamp_cell(std::floor(centerX - width / 2.0 * zoomScale));
+    min_y = clamp_cell(std::floor(centerY - height / 2.0 * zoomScale));
+    max_x = clamp_cell(std::ceil(centerX + width / 2.0 * zoomScale));
+    max_y = clamp_cell(std::ceil(centerY + height / 2.0 * zoomScale));
 }
 
 void display_window() {
     glClear(GL_COLOR_BUFFER_BIT);
 
-    update_global_board();
+    int width = glutGet(GLUT_WINDOW_WIDTH), height = glutGet(GLUT_WINDOW_HEIGHT);
+    int32_t min_x, min_y, max_x, max_y;
+    visible_cells(width, height, min_x, min_y, max_x, max_y);
 
-    for (const auto& cell : global_board) {
-        int factor = (10 * (1-zoomScale) + 1);
-        int x = cell.first * factor,
-            y = cell.second * factor;
-
-        for(int i = 0; i < factor + 1; i++){
-            for(int j = 0; j < factor + 1; j++){
-                set_pixel(x - i, y - j, 1.0, 0.0, 0.0); // Red
-            }
-        }
-    }
+    advance_playhead();
+    cursor->seek((uint64_t)playhead, min_x, min_y, max_x, max_y);
+    cursor->get_cells(frame_cells);
+    draw_cells(frame_cells, width, height);
+    update_title();
 
     glutSwapBuffers();
 }
 
-void updateProjection(int width, int height) {
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluOrtho2D(centerX - (width / 2.0) * zoomScale,
-               centerX + (width / 2.0) * zoomScale,
-               centerY - (height / 2.0) * zoomScale,
-               centerY + (height / 2.0) * zoomScale);
-    glMatrixMode(GL_MODELVIEW);
+void frame_timer(int) {
+    glutPostRedisplay();
+    glutTimerFunc(FRAME_MS, frame_timer, 0);
 }
 
+// Window pixels, y down like the board
 void reshape(int width, int height) {
     glViewport(0, 0, width, height);
-    updateProjection(width, height);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(0, width, height, 0, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
 }
 
 void zoom(int direction) {
@@ -69,9 +194,7 @@ void zoom(int direction) {
     } else {
         zoomScale *= (1 + zoomSpeed);
     }
-    int width = glutGet(GLUT_WINDOW_WIDTH);
-    int height = glutGet(GLUT_WINDOW_HEIGHT);
-    updateProjection(width, height);
+    zoomScale = std::max(zoomScale, 1.0f / 64);
     glutPostRedisplay();
 }
 
@@ -81,14 +204,10 @@ void pan(int xDirection, int yDirection) {
     centerX += xDirection * panSpeed;
     centerY += yDirection * panSpeed;
 
-    int width = glutGet(GLUT_WINDOW_WIDTH);
-    int height = glutGet(GLUT_WINDOW_HEIGHT);
-    updateProjection(width, height);
-
     glutPostRedisplay();
 }
 
-void specialKeys(int key, int x, int y) {
+void specialKeys(int key, int, int) {
     switch (key) {
         case GLUT_KEY_LEFT:
             pan(-1, 0);
@@ -97,15 +216,22 @@ void specialKeys(int key, int x, int y) {
             pan(1, 0);
             break;
         case GLUT_KEY_UP:
-            pan(0, 1);
+            pan(0, -1);
             break;
         case GLUT_KEY_DOWN:
-            pan(0, -1);
+            pan(0, 1);
+            break;
+        case GLUT_KEY_HOME: // oldest recorded generation
+            jump(-playhead);
+            break;
+        case GLUT_KEY_END:
+            jump((double)history->newest() - playhead);
             break;
     }
 }
 
-void keyboard(unsigned char key, int x, int y) {
+void keyboard(unsigned char key, int, int) {
+    double gps = target_gps;
     switch (key) {
         case '+':
             zoom(1);
@@ -113,31 +239,83 @@ void keyboard(unsigned char key, int x, int y) {
         case '-':
             zoom(-1);
             break;
+        case ' ':
+            paused = !paused;
+            break;
+        case '.': // one generation either way, pausing
+            jump(1);
+            break;
+        case ',':
+            jump(-1);
+            break;
+        case '>':
+            jump(JUMP_GENERATIONS);
+            break;
+        case '<':
+            jump(-(double)JUMP_GENERATIONS);
+            break;
+        case 'r': // play backward through what's recorded
+            direction = -direction;
+            break;
+        case ']': // 0 stays unlimited
+            target_gps = gps >= 4096 ? 0 : gps * 2;
+            break;
+        case '[':
+            target_gps = gps <= 0 ? 4096 : std::max(1.0, gps / 2);
+            break;
     }
 }
 
+// Centres the view on the starting pattern and zooms to fit it
+void fit_view(const std::vector<Cell> &cells, int width, int height) {
+    if (cells.empty()) return;
+
+    int32_t min_x = INT32_MAX, max_x = INT32_MIN, min_y = INT32_MAX, max_y = INT32_MIN;
+    for (const Cell &cell : cells) {
+        min_x = std::min(min_x, (int32_t)cell.first);
+        max_x = std::max(max_x, (int32_t)cell.first);
+        min_y = std::min(min_y, (int32_t)cell.second);
+        max_y = std::max(max_y, (int32_t)cell.second);
+    }
+
+    centerX = (min_x + max_x + 1) / 2.0f;
+    centerY = (min_y + max_y + 1) / 2.0f;
+    float fit = std::max((max_x - min_x + 1) / (float)width,
+                         (max_y - min_y + 1) / (float)height) * 1.1f;
+    zoomScale = std::max(fit, 1.0f / 8);
+}
 
 // Glut works through callbacks and runs its own loop
 // So.... yeah... we give it things
-void init_window(int argc, char** argv, Board start_board) {
+void init_window(int argc, char** argv, std::unique_ptr<Engine> engine) {
 
-    global_board = start_board;
+    global_engine = std::move(engine);
+    history = std::make_unique<History>(*global_engine, 0, HistoryOptions());
+    cursor = std::make_unique<HistoryCursor>(*history);
+    cursor->seek(0);
+    cursor->get_cells(frame_cells);
 
     glutInit(&argc, argv);
 
-    unsigned int window_width = 400;
-    unsigned int window_height = 400;
+    unsigned int window_width = 800;
+    unsigned int window_height = 800;
 
-    glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB);
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
     glutInitWindowSize(window_width, window_height);
     glutInitWindowPosition(100, 100);
-    glutCreateWindow("OpenGL Window");
+    glutCreateWindow("fast_life");
 
     glClearColor(0.0, 0.0, 0.0, 1.0);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
+    glGenTextures(1, &board_texture);
+    glBindTexture(GL_TEXTURE_2D, board_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 
-    gluOrtho2D(0.0, window_width, window_height, 0.0);
+    fit_view(frame_cells, window_width, window_height);
+    reshape(window_width, window_height);
 
     // These two handle zoom and that good good
     glutReshapeFunc(reshape);
@@ -145,5 +323,12 @@ void init_window(int argc, char** argv, Board start_board) {
     glutSpecialFunc(specialKeys);
 
     glutDisplayFunc(display_window);
+    glutTimerFunc(FRAME_MS, frame_timer, 0);
+
+    // GLUT leaves by calling exit(), make sure the producer is joined first
+    last_advance = std::chrono::steady_clock::now();
+    history->start();
+    std::atexit(stop_simulation);
+
     glutMainLoop();
 }
@@ -1,14 +1,17 @@
 #ifndef GL_UTILS_HPP
 #define GL_UTILS_HPP
 
+#ifdef __APPLE__
 #include <OpenGL/gl.h>
 #include <GLUT/glut.h>
-#include "game.hpp"
+#else
+#include <GL/gl.h>
+#include <GL/glut.h>
+#endif
+
+#include "engine.hpp"
 
-void set_pixel(int x, int y, float r, float g, float b);
 void display_window();
-void init_window(int argc, char** argv, Board board);
-void set_global_board(const Board &board);
+void init_window(int argc, char** argv, std::unique_ptr<Engine> engine);
 
 #endif // GL_UTILS_HPP
-
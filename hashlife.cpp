@@ -0,0 +1,499 @@
+#include <algorithm>
+
+#include "hashlife.hpp"
+#include "cell_hash.hpp"
+#include "metrics.hpp"
+
+static constexpr uint8_t FREE_LEVEL = UINT8_MAX;
+
+// Biggest single jump, keeps the root's coordinates inside int64
+static constexpr unsigned MAX_LOG_STEPS = 59;
+
+static uint64_t node_hash(uint32_t nw, uint32_t ne, uint32_t sw, uint32_t se) {
+    uint64_t h = nw * 0x9E3779B97F4A7C15ull;
+    h = (h ^ ne) * 0xBF58476D1CE4E5B9ull;
+    h = (h ^ sw) * 0x94D049BB133111EBull;
+    h = (h ^ se) * 0x9E3779B97F4A7C15ull;
+    return h ^ (h >> 31);
+}
+
+HashLife::HashLife(size_t memory_cap) : memory_cap(memory_cap), gc_threshold(memory_cap) {
+    // ids 0 and 1 are the dead and live cell, they never get freed
+    nodes.push_back({NONE, NONE, NONE, NONE, NONE, NONE, 0, 0, 0, 0, false, NONE});
+    nodes.push_back({NONE, NONE, NONE, NONE, NONE, NONE, 1, 1, 0, 0, false, NONE});
+    empties.push_back(0);
+    rehash(1 << 16);
+
+    build_base_table();
+    root = empty(3);
+}
+
+// 4x4 block, bit y*4 + x -> next generation of the 2x2 centre,
+// bit (y-1)*2 + (x-1)
+void HashLife::build_base_table() {
+    base_table.resize(1 << 16);
+    for(unsigned mask = 0; mask < (1u << 16); mask++) {
+        uint8_t out = 0;
+        for(int y = 1; y <= 2; y++) {
+            for(int x = 1; x <= 2; x++) {
+                int n_count = 0;
+                for(int dy = -1; dy <= 1; dy++) {
+                    for(int dx = -1; dx <= 1; dx++) {
+                        if(dx == 0 && dy == 0) continue;
+                        n_count += (mask >> ((y + dy) * 4 + x + dx)) & 1;
+                    }
+                }
+
+                bool alive = (mask >> (y * 4 + x)) & 1;
+                if(rule.next(alive, n_count)) {
+                    out |= 1 << ((y - 1) * 2 + (x - 1));
+                }
+            }
+        }
+        base_table[mask] = out;
+    }
+}
+
+void HashLife::set_rule(const Rule &r) {
+    if(r == rule) return;
+
+    rule = r;
+    build_base_table();
+
+    // every cached result was computed under the old rule
+    for(Node &n : nodes) n.result = n.step_result = NONE;
+}
+
+void HashLife::rehash(size_t bucket_count) {
+    buckets.assign(bucket_count, NONE);
+    for(NodeId i = 2; i < nodes.size(); i++) {
+        Node &n = nodes[i];
+        if(n.level == FREE_LEVEL) continue;
+
+        size_t b = node_hash(n.nw, n.ne, n.sw, n.se) & (bucket_count - 1);
+        n.next = buckets[b];
+        buckets[b] = i;
+    }
+}
+
+HashLife::NodeId HashLife::join(NodeId nw, NodeId ne, NodeId sw, NodeId se) {
+    size_t b = node_hash(nw, ne, sw, se) & (buckets.size() - 1);
+    for(NodeId i = buckets[b]; i != NONE; i = nodes[i].next) {
+        const Node &n = nodes[i];
+        if(n.nw == nw && n.ne == ne && n.sw == sw && n.se == se) return i;
+    }
+
+    Node n;
+    n.nw = nw; n.ne = ne; n.sw = sw; n.se = se;
+    n.result = NONE;
+    n.population = nodes[nw].population + nodes[ne].population +
+                   nodes[sw].population + nodes[se].population;
+    n.level = nodes[nw].level + 1;
+    n.hash = nodes[nw].hash + nodes[ne].hash * hash_pow2_x(n.level - 1) +
+             (nodes[sw].hash + nodes[se].hash * hash_pow2_x(n.level - 1)) * hash_pow2_y(n.level - 1);
+    n.result_log = 0;
+    n.marked = false;
+    n.step_result = NONE;
+
+    NodeId id;
+    if(free_list != NONE) {
+        id = free_list;
+        free_list = nodes[id].next;
+        free_count--;
+        nodes[id] = n;
+    } else {
+        id = nodes.size();
+        nodes.push_back(n);
+    }
+
+    nodes[id].next = buckets[b];
+    buckets[b] = id;
+
+    if(node_count() > buckets.size()) rehash(buckets.size() * 2);
+    return id;
+}
+
+HashLife::NodeId HashLife::empty(unsigned level) {
+    while(empties.size() <= level) {
+        NodeId e = empties.back();
+        empties.push_back(join(e, e, e, e));
+    }
+    return empties[level];
+}
+
+// Same square one level up, with n in the middle
+HashLife::NodeId HashLife::expand(NodeId n) {
+    NodeId nw = nodes[n].nw, ne = nodes[n].ne;
+    NodeId sw = nodes[n].sw, se = nodes[n].se;
+    NodeId e = empty(nodes[n].level - 1);
+
+    return join(join(e, e, e, nw), join(e, e, ne, e),
+                join(e, sw, e, e), join(se, e, e, e));
+}
+
+HashLife::NodeId HashLife::centre(NodeId n) {
+    const Node &c = nodes[n];
+    return join(nodes[c.nw].se, nodes[c.ne].sw,
+                nodes[c.sw].ne, nodes[c.se].nw);
+}
+
+HashLife::NodeId HashLife::centre_h(NodeId w, NodeId e) {
+    return join(nodes[w].ne, nodes[e].nw, nodes[w].se, nodes[e].sw);
+}
+
+HashLife::NodeId HashLife::centre_v(NodeId n, NodeId s) {
+    return join(nodes[n].sw, nodes[n].se, nodes[s].nw, nodes[s].ne);
+}
+
+HashLife::NodeId HashLife::base_result(NodeId n) {
+    const Node &b = nodes[n];
+    const NodeId quads[4] = {b.nw, b.ne, b.sw, b.se};
+
+    unsigned mask = 0;
+    for(int q = 0; q < 4; q++) {
+        const Node &c = nodes[quads[q]];
+        unsigned x = (q & 1) * 2, y = (q >> 1) * 2;
+        mask |= c.nw << (y * 4 + x);
+        mask |= c.ne << (y * 4 + x + 1);
+        mask |= c.sw << ((y + 1) * 4 + x);
+        mask |= c.se << ((y + 1) * 4 + x + 1);
+    }
+
+    uint8_t out = base_table[mask];
+    return join(out & 1, (out >> 1) & 1, (out >> 2) & 1, (out >> 3) & 1);
+}
+
+// The centre half of n, advanced 2^log_steps generations. Needs
+// log_steps <= level - 2. NONE when the jump was abandoned for growing the
+// store past gc_threshold, see advance_pow2.
+HashLife::NodeId HashLife::result(NodeId n, unsigned log_steps) {
+    unsigned level = nodes[n].level;
+
+    if(nodes[n].population == 0) return empty(level - 1);
+    if(log_steps == 0 && nodes[n].step_result != NONE) return nodes[n].step_result;
+    if(log_steps > 0 && nodes[n].result != NONE && nodes[n].result_log == log_steps) {
+        return nodes[n].result;
+    }
+    if(abandonable && store_bytes() > gc_threshold) return NONE;
+
+    NodeId r;
+    if(level == 2) {
+        r = base_result(n);
+    } else {
+        NodeId nw = nodes[n].nw, ne = nodes[n].ne;
+        NodeId sw = nodes[n].sw, se = nodes[n].se;
+
+        NodeId m[9] = {
+            nw, centre_h(nw, ne), ne,
+            centre_v(nw, sw), centre(n), centre_v(ne, se),
+            sw, centre_h(sw, se), se,
+        };
+
+        // full speed spends half the time in each stage, slower jumps
+        // just take the centres for the first stage
+        for(NodeId &sub : m) {
+            sub = log_steps == level - 2 ? result(sub, level - 3) : centre(sub);
+            if(sub == NONE) return NONE;
+        }
+
+        unsigned second = std::min(log_steps, level - 3);
+        const NodeId quads[4][4] = {
+            {m[0], m[1], m[3], m[4]}, {m[1], m[2], m[4], m[5]},
+            {m[3], m[4], m[6], m[7]}, {m[4], m[5], m[7], m[8]},
+        };
+        NodeId q[4];
+        for(int i = 0; i < 4; i++) {
+            q[i] = result(join(quads[i][0], quads[i][1], quads[i][2], quads[i][3]), second);
+            if(q[i] == NONE) return NONE;
+        }
+        r = join(q[0], q[1], q[2], q[3]);
+    }
+
+    if(log_steps == 0) {
+        nodes[n].step_result = r;
+    } else {
+        nodes[n].result = r;
+        nodes[n].result_log = log_steps;
+    }
+    return r;
+}
+
+bool HashLife::in_inner_quarter(NodeId n) const {
+    const Node &c = nodes[n];
+    uint64_t inner = nodes[nodes[nodes[c.nw].se].se].population +
+                     nodes[nodes[nodes[c.ne].sw].sw].population +
+                     nodes[nodes[nodes[c.sw].ne].ne].population +
+                     nodes[nodes[nodes[c.se].nw].nw].population;
+    return inner == c.population;
+}
+
+void HashLife::collect_if_full() {
+    if(store_bytes() <= gc_threshold) return;
+
+    METRICS_BEGIN(PHASE_GC);
+    collect_garbage();
+    gc_threshold = std::max(memory_cap, 2 * store_bytes());
+    METRICS_END(PHASE_GC);
+}
+
+void HashLife::advance_pow2(unsigned log_steps) {
+    collect_if_full();
+
+    METRICS_BEGIN(PHASE_COMPUTE);
+
+    // Light speed is one cell per generation, so with the pattern in the
+    // inner quarter and 2^log_steps <= a quarter of the width, everything
+    // stays inside the centre half that result() hands back.
+    while(nodes[root].level < log_steps + 3 || !in_inner_quarter(root)) {
+        root = expand(root);
+    }
+
+    // Nothing in flight survives an abandoned jump, only the root and the
+    // results already cached under it, so the collection needs no pinning.
+    // Single generations always run to the end, they can't get smaller.
+    abandonable = log_steps > 0;
+    NodeId r = result(root, log_steps);
+    abandonable = false;
+    METRICS_END(PHASE_COMPUTE);
+
+    if(r != NONE) {
+        root = r;
+        return;
+    }
+    collect_if_full();
+    advance_pow2(log_steps - 1);
+    advance_pow2(log_steps - 1);
+}
+
+void HashLife::advance(uint64_t generations) {
+    METRICS_GENERATION(*this, generations);
+    for(unsigned j = 0; j < MAX_LOG_STEPS; j++) {
+        if(generations & ((uint64_t)1 << j)) advance_pow2(j);
+    }
+    for(uint64_t big = generations >> MAX_LOG_STEPS; big > 0; big--) {
+        advance_pow2(MAX_LOG_STEPS);
+    }
+}
+
+void HashLife::collect_garbage() {
+    std::vector<NodeId> stack = {root};
+    stack.insert(stack.end(), empties.begin(), empties.end());
+
+    while(!stack.empty()) {
+        NodeId id = stack.back();
+        stack.pop_back();
+
+        Node &n = nodes[id];
+        if(n.marked) continue;
+        n.marked = true;
+
+        if(n.level > 0) {
+            stack.push_back(n.nw);
+            stack.push_back(n.ne);
+            stack.push_back(n.sw);
+            stack.push_back(n.se);
+        }
+    }
+
+    for(NodeId i = 2; i < nodes.size(); i++) {
+        Node &n = nodes[i];
+        if(n.level == FREE_LEVEL) continue;
+
+        if(!n.marked) {
+            n.level = FREE_LEVEL;
+            n.next = free_list;
+            free_list = i;
+            free_count++;
+        } else {
+            if(n.result != NONE && !nodes[n.result].marked) n.result = NONE;
+            if(n.step_result != NONE && !nodes[n.step_result].marked) n.step_result = NONE;
+        }
+    }
+
+    for(Node &n : nodes) n.marked = false;
+    rehash(buckets.size());
+}
+
+size_t HashLife::store_bytes() const {
+    return node_count() * sizeof(Node) + buckets.size() * sizeof(NodeId);
+}
+
+size_t HashLife::memory_used() const {
+    return nodes.capacity() * sizeof(Node) + buckets.size() * sizeof(NodeId);
+}
+
+size_t HashLife::population() const {
+    return nodes[root].population;
+}
+
+uint64_t HashLife::hash() const {
+    // the root's corner is at -(half its width) on both axes
+    int64_t origin = -((int64_t)1 << (nodes[root].level - 1));
+    return hash_translate(nodes[root].hash, origin, origin);
+}
+
+HashLife::NodeId HashLife::build(Points::iterator begin, Points::iterator end,
+                                 unsigned level, int64_t x0, int64_t y0) {
+
+    if(begin == end) return empty(level);
+    if(level == 0) return 1;
+
+    int64_t half = (int64_t)1 << (level - 1);
+    auto mid_y = std::partition(begin, end,
+            [&](const auto &p) { return p.second < y0 + half; });
+    auto mid_n = std::partition(begin, mid_y,
+            [&](const auto &p) { return p.first < x0 + half; });
+    auto mid_s = std::partition(mid_y, end,
+            [&](const auto &p) { return p.first < x0 + half; });
+
+    NodeId nw = build(begin, mid_n, level - 1, x0, y0);
+    NodeId ne = build(mid_n, mid_y, level - 1, x0 + half, y0);
+    NodeId sw = build(mid_y, mid_s, level - 1, x0, y0 + half);
+    NodeId se = build(mid_s, end, level - 1, x0 + half, y0 + half);
+    return join(nw, ne, sw, se);
+}
+
+void HashLife::clear() {
+    root = empty(3);
+    pending.clear();
+}
+
+void HashLife::add_run(unsigned x, unsigned y, unsigned length) {
+    for(unsigned i = 0; i < length; i++) {
+        pending.push_back({(int32_t)(x + i), (int32_t)y});
+    }
+}
+
+void HashLife::commit() {
+    if(pending.empty()) return;
+
+    // anything already in the tree joins the new cells
+    auto keep = [&](int64_t x, int64_t y) { pending.push_back({x, y}); };
+    int64_t origin = -((int64_t)1 << (nodes[root].level - 1));
+    visit_cells(root, origin, origin, keep);
+
+    std::sort(pending.begin(), pending.end());
+    pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+
+    int64_t extent = 0;
+    for(const auto &[x, y] : pending) {
+        extent = std::max({extent, x < 0 ? -x : x + 1, y < 0 ? -y : y + 1});
+    }
+
+    unsigned level = 3;
+    while(((int64_t)1 << (level - 1)) < extent) level++;
+
+    origin = -((int64_t)1 << (level - 1));
+    root = build(pending.begin(), pending.end(), level, origin, origin);
+
+    pending.clear();
+    pending.shrink_to_fit();
+}
+
+void HashLife::set_board(const Board &board) {
+    clear();
+    for(const Cell &c : board) {
+        pending.push_back({(int32_t)c.first, (int32_t)c.second});
+    }
+    commit();
+}
+
+template <typename F>
+void HashLife::visit_cells(NodeId id, int64_t x0, int64_t y0, F &visit) const {
+    const Node &n = nodes[id];
+    if(n.population == 0) return;
+
+    if(n.level == 0) {
+        visit(x0, y0);
+        return;
+    }
+
+    int64_t half = (int64_t)1 << (n.level - 1);
+    visit_cells(n.nw, x0, y0, visit);
+    visit_cells(n.sw, x0, y0 + half, visit);
+    visit_cells(n.ne, x0 + half, y0, visit);
+    visit_cells(n.se, x0 + half, y0 + half, visit);
+}
+
+// Smallest x (y when vertical, largest when high) of any live cell under
+// n, if it beats best. The near half goes first, which usually leaves
+// nothing on the far side that could do better.
+void HashLife::extreme(NodeId id, int64_t x0, int64_t y0, bool vertical, bool high,
+                       bool &found, int64_t &best) const {
+    const Node &n = nodes[id];
+    if(n.population == 0) return;
+
+    int64_t lo = vertical ? y0 : x0;
+    int64_t size = (int64_t)1 << n.level;
+    if(found && (high ? lo + size - 1 <= best : lo >= best)) return;
+    if(n.level == 0) {
+        best = lo;
+        found = true;
+        return;
+    }
+
+    int64_t half = size / 2;
+    const struct { NodeId id; int64_t x, y; } quads[4] = {
+        {n.nw, x0, y0}, {n.ne, x0 + half, y0},
+        {n.sw, x0, y0 + half}, {n.se, x0 + half, y0 + half},
+    };
+    // bit 0 of the index is the east half, bit 1 the south
+    int axis = vertical ? 2 : 1;
+    for(int far = 0; far < 2; far++) {
+        for(int i = 0; i < 4; i++) {
+            if((((i & axis) != 0) != high) == (far != 0)) {
+                extreme(quads[i].id, quads[i].x, quads[i].y, vertical, high, found, best);
+            }
+        }
+    }
+}
+
+bool HashLife::bounding_box(int32_t &min_x, int32_t &min_y,
+                            int32_t &max_x, int32_t &max_y) const {
+    if(nodes[root].population == 0) return false;
+
+    int64_t origin = -((int64_t)1 << (nodes[root].level - 1));
+    int64_t box[4];
+    for(int side = 0; side < 4; side++) {
+        bool found = false;
+        extreme(root, origin, origin, side & 1, side >= 2, found, box[side]);
+    }
+
+    // past the int32 range the other engines have wrapped, so do it their way
+    for(int64_t v : box) {
+        if(v < INT32_MIN || v > INT32_MAX) return Engine::bounding_box(min_x, min_y, max_x, max_y);
+    }
+    min_x = (int32_t)box[0];
+    min_y = (int32_t)box[1];
+    max_x = (int32_t)box[2];
+    max_y = (int32_t)box[3];
+    return true;
+}
+
+Board HashLife::get_board() const {
+    Board board;
+    auto insert = [&](int64_t x, int64_t y) {
+        board.insert(board.end(), {(unsigned)x, (unsigned)y});
+    };
+
+    int64_t origin = -((int64_t)1 << (nodes[root].level - 1));
+    visit_cells(root, origin, origin, insert);
+    return board;
+}
+
+void HashLife::get_cells(std::vector<Cell> &cells) const {
+    cells.clear();
+    auto push = [&](int64_t x, int64_t y) {
+        cells.push_back({(unsigned)x, (unsigned)y});
+    };
+
+    int64_t origin = -((int64_t)1 << (nodes[root].level - 1));
+    visit_cells(root, origin, origin, push);
+}
+
+void hashlife_advance(Board &board, uint64_t generations, size_t memory_cap) {
+    HashLife life(memory_cap);
+    life.set_board(board);
+    life.advance(generations);
+    board = life.get_board();
+}
@@ -0,0 +1,126 @@
+#ifndef HASHLIFE_HPP
+#define HASHLIFE_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "engine.hpp"
+
+// Gosper's HashLife. The universe is a canonical quadtree: every distinct
+// square is stored once in a hash-consed node store, and each node caches
+// the RESULT of advancing its centre by a power of two generations, so
+// repeated structure in space and time is only ever computed once. The
+// one generation result gets its own slot, so single steps and jumps
+// don't keep overwriting each other's.
+//
+// The root is centred on the origin. Board cells are read as signed 32 bit
+// values, so patterns that wrap past 0 in the unsigned Cell space come out
+// the same as they do in the other engines.
+class HashLife : public Engine {
+public:
+    // memory_cap is in bytes and covers the node store and its hash table
+    explicit HashLife(size_t memory_cap = (size_t)1 << 30);
+
+    const char *name() const override { return "hashlife"; }
+
+    void set_board(const Board &board) override;
+    Board get_board() const override;
+    void get_cells(std::vector<Cell> &cells) const override;
+    // from the quadtree, only walking down the sides that can still win
+    bool bounding_box(int32_t &min_x, int32_t &min_y,
+                      int32_t &max_x, int32_t &max_y) const override;
+
+    void clear() override;
+    void add_run(unsigned x, unsigned y, unsigned length) override;
+    // builds the quadtree from everything add_run collected
+    void commit() override;
+
+    // rebuilds the 4x4 base table and throws away every cached result
+    void set_rule(const Rule &r) override;
+
+    void step() override { advance(1); }
+    size_t population() const override;
+    // from the per-node hashes, no need to track births and deaths
+    uint64_t hash() const override;
+
+    // Any number of generations, done as one power-of-two jump per set bit
+    void advance(uint64_t generations) override;
+
+    void set_memory_cap(size_t bytes) { memory_cap = gc_threshold = bytes; }
+    size_t node_count() const { return nodes.size() - free_count; }
+    size_t memory_used() const;
+
+    // Drops every node not reachable from the root, along with any cached
+    // results that pointed at them.
+    void collect_garbage();
+
+private:
+    typedef uint32_t NodeId;
+    static constexpr NodeId NONE = UINT32_MAX;
+
+    struct Node {
+        NodeId nw, ne, sw, se;
+        NodeId result;
+        NodeId next;        // hash chain, or free list when unused
+        uint64_t population;
+        uint64_t hash;      // cell_hash.hpp hash relative to the node's corner
+        uint8_t level;
+        uint8_t result_log; // result advances 2^result_log generations
+        bool marked;
+        NodeId step_result; // one generation on, kept apart from result
+    };
+
+    NodeId join(NodeId nw, NodeId ne, NodeId sw, NodeId se);
+    NodeId empty(unsigned level);
+    NodeId expand(NodeId n);
+    NodeId centre(NodeId n);
+    NodeId centre_h(NodeId w, NodeId e);
+    NodeId centre_v(NodeId n, NodeId s);
+    NodeId result(NodeId n, unsigned log_steps);
+    NodeId base_result(NodeId n);
+    bool in_inner_quarter(NodeId n) const;
+    // A jump that would take the store past gc_threshold is abandoned,
+    // collected after and done as two half-size jumps instead, so the cap
+    // holds inside a jump as well as between them
+    void advance_pow2(unsigned log_steps);
+    void collect_if_full();
+    // what the cap is checked against
+    size_t store_bytes() const;
+
+    typedef std::vector<std::pair<int64_t, int64_t>> Points;
+
+    NodeId build(Points::iterator begin, Points::iterator end,
+                 unsigned level, int64_t x0, int64_t y0);
+    template <typename F>
+    void visit_cells(NodeId n, int64_t x0, int64_t y0, F &visit) const;
+    void extreme(NodeId n, int64_t x0, int64_t y0, bool vertical, bool high,
+                 bool &found, int64_t &best) const;
+
+    void rehash(size_t buckets);
+    void build_base_table();
+
+    std::vector<Node> nodes;
+    std::vector<NodeId> buckets;
+    std::vector<NodeId> empties;
+    NodeId free_list = NONE;
+    size_t free_count = 0;
+    size_t memory_cap;
+    // usually memory_cap, raised when the live tree alone is near the cap
+    // so a step-at-a-time caller doesn't collect every generation
+    size_t gc_threshold;
+    // result() gives up with NONE once the store passes gc_threshold
+    bool abandonable = false;
+
+    NodeId root;
+    Points pending;
+
+    // next generation of the centre 2x2 of every 4x4 block
+    std::vector<uint8_t> base_table;
+};
+
+// Convenience for callers that only have a Board: jumps it forward by
+// `generations` through a temporary HashLife universe.
+void hashlife_advance(Board &board, uint64_t generations,
+                      size_t memory_cap = (size_t)1 << 30);
+
+#endif // HASHLIFE_HPP
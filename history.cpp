@@ -0,0 +1,331 @@
+#include <algorithm>
+
+#include "history.hpp"
+#include "engine.hpp"
+
+// rough cost of a frame beyond its cells, so empty deltas still count
+static const size_t FRAME_OVERHEAD = 64;
+
+static uint64_t cell_key(unsigned x, unsigned y) {
+    return ((uint64_t)y << 32) | x;
+}
+
+static void sorted_keys(const std::vector<Cell> &cells, std::vector<uint64_t> &keys) {
+    keys.resize(cells.size());
+    for(size_t i = 0; i < cells.size(); i++) keys[i] = cell_key(cells[i].first, cells[i].second);
+    std::sort(keys.begin(), keys.end());
+}
+
+static void engine_keys(const Engine &engine, std::vector<Cell> &cells, std::vector<uint64_t> &keys) {
+    engine.get_cells(cells);
+    sorted_keys(cells, keys);
+}
+
+History::History(Engine &engine, uint64_t generation, const HistoryOptions &opts, StepHook hook)
+    : engine(engine), opts(opts), hook(std::move(hook)),
+      first(generation), playhead(generation), generation(generation) {
+    if(this->opts.keyframe_every == 0) this->opts.keyframe_every = 1;
+
+    std::vector<Cell> cells;
+    engine_keys(engine, cells, current);
+    have_current = true;
+    frames.push_back({nullptr, std::make_shared<const Keys>(current), current.size()});
+    bytes = FRAME_OVERHEAD + current.size() * sizeof(uint64_t);
+
+    engine.track_changes();
+}
+
+History::~History() {
+    stop();
+}
+
+void History::start() {
+    if(running) return;
+    running = true;
+    producer = std::thread(&History::produce, this);
+}
+
+void History::stop() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        running = false;
+    }
+    wake.notify_all();
+    if(producer.joinable()) producer.join();
+}
+
+uint64_t History::oldest() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return first;
+}
+
+uint64_t History::newest() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return first + frames.size() - 1;
+}
+
+size_t History::memory_used() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return bytes;
+}
+
+void History::set_playhead(uint64_t gen) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(gen == playhead) return;
+        playhead = gen;
+    }
+    wake.notify_all();
+}
+
+size_t History::frame_bytes(const Frame &frame) {
+    const auto &delta = frame.delta;
+    const auto &keyframe = frame.keyframe;
+    size_t n = FRAME_OVERHEAD;
+    if(delta) n += (delta->births.size() + delta->deaths.size()) * sizeof(uint64_t);
+    if(keyframe) n += keyframe->size() * sizeof(uint64_t);
+    return n;
+}
+
+void History::record(uint64_t gen, std::shared_ptr<const Keys> key, std::shared_ptr<const Delta> delta) {
+    std::lock_guard<std::mutex> guard(lock);
+    generation = gen;
+    if(!delta) {
+        // restarted somewhere else, nothing before it connects
+        frames.clear();
+        bytes = 0;
+        first = generation;
+    }
+    uint64_t population = key ? key->size()
+                              : frames.back().population + delta->births.size() - delta->deaths.size();
+    frames.push_back({delta, key, population});
+    bytes += frame_bytes(frames.back());
+    trim();
+}
+
+bool History::trim() {
+    // Drop the oldest keyframe and its deltas while over budget, as long
+    // as the next keyframe is still at or before the playhead
+    while(bytes > opts.memory_budget) {
+        size_t next = 1;
+        while(next < frames.size() && !frames[next].keyframe) next++;
+        if(next >= frames.size() || first + next > playhead) return false;
+
+        for(size_t i = 0; i < next; i++) {
+            bytes -= frame_bytes(frames.front());
+            frames.pop_front();
+        }
+        first += next;
+    }
+    return true;
+}
+
+void History::produce() {
+    std::vector<Cell> cells;
+    CellChanges changes;
+    Keys next;
+
+    while(running) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            // Past the budget with nothing left to drop, only a caught up
+            // playhead gets another generation. That one lets the playhead
+            // reach the next keyframe, and then the group behind it can go.
+            wake.wait(guard, [&] {
+                return !running || (generation < playhead + opts.max_lead &&
+                                    (trim() || generation <= playhead));
+            });
+            if(!running) break;
+        }
+        if(generation >= opts.last_generation) break;
+
+        engine.step();
+        uint64_t stepped = generation + 1, gen = stepped;
+        bool stop = hook && hook(engine, gen);
+
+        // Engines that know their births and deaths only have those sorted.
+        // The rest are diffed against the cells kept from the step before;
+        // an engine that stops reporting changes starts a new recording.
+        bool tracked = gen == stepped && engine.get_changes(changes);
+        std::shared_ptr<Delta> delta;
+        if(tracked) {
+            delta = std::make_shared<Delta>();
+            sorted_keys(changes.born, delta->births);
+            sorted_keys(changes.died, delta->deaths);
+        } else {
+            engine_keys(engine, cells, next);
+            if(gen == stepped && have_current) {
+                delta = std::make_shared<Delta>();
+                std::set_difference(next.begin(), next.end(), current.begin(), current.end(),
+                                    std::back_inserter(delta->births));
+                std::set_difference(current.begin(), current.end(), next.begin(), next.end(),
+                                    std::back_inserter(delta->deaths));
+            }
+        }
+
+        std::shared_ptr<const Keys> key;
+        if(!delta || gen % opts.keyframe_every == 0) {
+            if(tracked) engine_keys(engine, cells, next);
+            key = std::make_shared<const Keys>(next);
+        }
+        have_current = !tracked;
+        if(have_current) current.swap(next);
+        else current = Keys();
+        next.clear();
+
+        record(gen, key, delta);
+
+        if(stop) break;
+    }
+    done = true;
+}
+
+// keys = (keys - remove) + add, all sorted
+static void apply_delta(std::vector<uint64_t> &keys, const std::vector<uint64_t> &remove,
+                        const std::vector<uint64_t> &add, std::vector<uint64_t> &scratch,
+                        std::vector<uint64_t> &merged) {
+    scratch.clear();
+    std::set_difference(keys.begin(), keys.end(), remove.begin(), remove.end(),
+                        std::back_inserter(scratch));
+    merged.clear();
+    std::merge(scratch.begin(), scratch.end(), add.begin(), add.end(),
+               std::back_inserter(merged));
+    keys.swap(merged);
+}
+
+// A signed range as one or two unsigned ones, split where it crosses zero
+static int unsigned_ranges(int32_t lo, int32_t hi, uint32_t ranges[2][2]) {
+    if(lo > hi) return 0;
+    if(lo < 0 && hi >= 0) {
+        ranges[0][0] = (uint32_t)lo;
+        ranges[0][1] = UINT32_MAX;
+        ranges[1][0] = 0;
+        ranges[1][1] = (uint32_t)hi;
+        return 2;
+    }
+    ranges[0][0] = (uint32_t)lo;
+    ranges[0][1] = (uint32_t)hi;
+    return 1;
+}
+
+// The keys of src inside the box, sorted. Short lists are filtered
+// straight through; otherwise keys are in row order, so each row of the
+// box is one search in and one to skip past whatever sits right of it.
+static void keys_in_box(const std::vector<uint64_t> &src, int32_t min_x, int32_t min_y,
+                        int32_t max_x, int32_t max_y, std::vector<uint64_t> &out) {
+    out.clear();
+    if(min_x > max_x || min_y > max_y) return;
+
+    uint64_t rows = (uint64_t)((int64_t)max_y - min_y) + 1;
+    if(src.size() <= rows) {
+        for(uint64_t k : src) {
+            int32_t x = (int32_t)(uint32_t)k, y = (int32_t)(uint32_t)(k >> 32);
+            if(x >= min_x && x <= max_x && y >= min_y && y <= max_y) out.push_back(k);
+        }
+        return;
+    }
+
+    uint32_t xs[2][2], ys[2][2];
+    int nx = unsigned_ranges(min_x, max_x, xs), ny = unsigned_ranges(min_y, max_y, ys);
+    for(int j = 0; j < ny; j++) {
+        for(int i = 0; i < nx; i++) {
+            uint32_t x_lo = xs[i][0], x_hi = xs[i][1], y_hi = ys[j][1];
+            auto it = std::lower_bound(src.begin(), src.end(), cell_key(x_lo, ys[j][0]));
+            while(it != src.end()) {
+                uint32_t x = (uint32_t)*it, y = (uint32_t)(*it >> 32);
+                if(y > y_hi) break;
+                if(x < x_lo) {
+                    it = std::lower_bound(it, src.end(), cell_key(x_lo, y));
+                } else if(x > x_hi) {
+                    if(y == y_hi) break;
+                    it = std::lower_bound(it, src.end(), cell_key(x_lo, y + 1));
+                } else {
+                    out.push_back(*it);
+                    ++it;
+                }
+            }
+        }
+    }
+    // a box across an axis comes out a range at a time
+    if(nx * ny > 1) std::sort(out.begin(), out.end());
+}
+
+uint64_t HistoryCursor::seek(uint64_t target) {
+    return seek(target, Box());
+}
+
+uint64_t HistoryCursor::seek(uint64_t target, int32_t min_x, int32_t min_y,
+                             int32_t max_x, int32_t max_y) {
+    Box view;
+    view.min_x = min_x;
+    view.min_y = min_y;
+    view.max_x = max_x;
+    view.max_y = max_y;
+    return seek(target, view);
+}
+
+uint64_t HistoryCursor::seek(uint64_t target, const Box &view) {
+    std::shared_ptr<const History::Keys> base;
+    std::vector<std::shared_ptr<const History::Delta>> steps;
+    bool backward = false;
+    {
+        // only pointers are copied under the lock, the work happens after
+        std::lock_guard<std::mutex> guard(history.lock);
+        uint64_t lo = history.first, hi = history.first + history.frames.size() - 1;
+        target = std::clamp(target, lo, hi);
+        total = history.frames[target - lo].population;
+
+        uint64_t distance = target >= at ? target - at : at - target;
+        if(valid && view == box && at >= lo && at <= hi && distance <= history.opts.keyframe_every) {
+            backward = target < at;
+            if(backward) {
+                for(uint64_t g = at; g > target; g--) steps.push_back(history.frames[g - lo].delta);
+            } else {
+                for(uint64_t g = at + 1; g <= target; g++) steps.push_back(history.frames[g - lo].delta);
+            }
+        } else {
+            uint64_t k = target;
+            while(!history.frames[k - lo].keyframe) k--;
+            base = history.frames[k - lo].keyframe;
+            for(uint64_t g = k + 1; g <= target; g++) steps.push_back(history.frames[g - lo].delta);
+        }
+    }
+
+    box = view;
+    bool whole = box == Box();
+    if(base) {
+        if(whole) keys = *base;
+        else keys_in_box(*base, box.min_x, box.min_y, box.max_x, box.max_y, keys);
+    }
+    for(const auto &d : steps) {
+        const History::Keys *add = backward ? &d->deaths : &d->births;
+        const History::Keys *remove = backward ? &d->births : &d->deaths;
+        if(!whole) {
+            keys_in_box(*add, box.min_x, box.min_y, box.max_x, box.max_y, births);
+            keys_in_box(*remove, box.min_x, box.min_y, box.max_x, box.max_y, deaths);
+            add = &births;
+            remove = &deaths;
+        }
+        apply_delta(keys, *remove, *add, scratch, merged);
+    }
+    at = target;
+    valid = true;
+    return at;
+}
+
+void HistoryCursor::get_cells(std::vector<Cell> &cells) const {
+    cells.resize(keys.size());
+    for(size_t i = 0; i < keys.size(); i++) {
+        cells[i] = {(uint32_t)keys[i], (uint32_t)(keys[i] >> 32)};
+    }
+}
+
+void HistoryCursor::get_cells(std::vector<Cell> &cells, int32_t min_x, int32_t min_y,
+                              int32_t max_x, int32_t max_y) const {
+    std::vector<uint64_t> inside;
+    keys_in_box(keys, min_x, min_y, max_x, max_y, inside);
+    cells.resize(inside.size());
+    for(size_t i = 0; i < inside.size(); i++) {
+        cells[i] = {(uint32_t)inside[i], (uint32_t)(inside[i] >> 32)};
+    }
+}
@@ -0,0 +1,168 @@
+#ifndef HISTORY_HPP
+#define HISTORY_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "game.hpp"
+
+class Engine;
+
+// Recorded run for the viewers. A producer thread steps the engine ahead
+// of whatever generation is on screen (the playhead) and records every
+// generation as the cells born and the cells that died since the one
+// before, with a full keyframe every so often. Old generations fall off
+// the front, a whole keyframe's worth at a time, once the lot goes over
+// the memory budget. The keyframe the playhead needs never goes; when
+// nothing older is left to drop the producer waits for the playhead
+// instead of running further ahead.
+//
+// Deltas come straight from the engine's births and deaths when it keeps
+// them (Engine::get_changes), so recording a generation costs what changed
+// rather than the whole board; other engines get diffed.
+//
+// Deltas work both ways, so a HistoryCursor steps backward as cheaply as
+// forward, and any stored generation is at most keyframe_every deltas
+// away from a keyframe. Readers only hold the lock long enough to copy
+// pointers, a long step never holds up a frame, and a cursor given a view
+// box only ever merges the cells inside it.
+
+struct HistoryOptions {
+    size_t memory_budget = (size_t)256 << 20;
+    uint64_t keyframe_every = 64;
+    // generations computed past the playhead, long enough that unlimited
+    // speed isn't held back by the frame rate
+    uint64_t max_lead = 4096;
+    uint64_t last_generation = UINT64_MAX;
+};
+
+class History {
+public:
+    // Called on the producer thread after every step. May move the engine
+    // on (a skipped cycle), in which case everything stored so far is
+    // dropped and recording starts over at the new generation. Returning
+    // true stops the producer.
+    typedef std::function<bool(Engine &engine, uint64_t &generation)> StepHook;
+
+    // The engine belongs to the producer thread until stop()
+    History(Engine &engine, uint64_t generation, const HistoryOptions &opts,
+            StepHook hook = nullptr);
+    ~History();
+
+    History(const History &) = delete;
+    History &operator=(const History &) = delete;
+
+    void start();
+    void stop();
+
+    // Stored generations are [oldest(), newest()]
+    uint64_t oldest() const;
+    uint64_t newest() const;
+    // the producer has hit last_generation or the hook stopped it
+    bool finished() const { return done; }
+    size_t memory_used() const;
+
+    // The producer keeps newest() up to max_lead past this
+    void set_playhead(uint64_t generation);
+
+    const HistoryOptions &options() const { return opts; }
+
+private:
+    friend class HistoryCursor;
+
+    typedef std::vector<uint64_t> Keys; // sorted (y << 32) | x
+
+    struct Delta {
+        Keys births, deaths;
+    };
+
+    struct Frame {
+        std::shared_ptr<const Delta> delta; // from the generation before
+        std::shared_ptr<const Keys> keyframe; // null between keyframes
+        uint64_t population;
+    };
+
+    void produce();
+    // A null delta means gen doesn't follow on from what's stored, and
+    // then key has to be set
+    void record(uint64_t gen, std::shared_ptr<const Keys> key, std::shared_ptr<const Delta> delta);
+    // Drops keyframe groups from the front while over budget, short of the
+    // one holding the playhead. False if still over budget. Needs the lock.
+    bool trim();
+    static size_t frame_bytes(const Frame &frame);
+
+    Engine &engine;
+    HistoryOptions opts;
+    StepHook hook;
+
+    mutable std::mutex lock;
+    std::condition_variable wake;
+    std::deque<Frame> frames; // frames[i] is generation first + i
+    uint64_t first = 0;
+    uint64_t playhead = 0;
+    size_t bytes = 0;
+    // where the producer is, and its cells while the engine can't report
+    // its own births and deaths
+    uint64_t generation;
+    Keys current;
+    bool have_current = false;
+
+    std::thread producer;
+    std::atomic<bool> running{false};
+    std::atomic<bool> done{false};
+};
+
+// One reader's view of a History: the cells of a single generation, moved
+// around by applying deltas forward or backward from where it last was.
+// Seeking with a box keeps only the cells inside it (inclusive and signed)
+// and skips the parts of every delta outside it, so a frame costs what's
+// on screen rather than the whole board. Changing the box starts again
+// from the nearest keyframe.
+class HistoryCursor {
+public:
+    explicit HistoryCursor(const History &history) : history(history) {}
+
+    // Moves to the stored generation nearest `target` and returns it
+    uint64_t seek(uint64_t target);
+    uint64_t seek(uint64_t target, int32_t min_x, int32_t min_y,
+                  int32_t max_x, int32_t max_y);
+
+    uint64_t generation() const { return at; }
+    // of the whole board, whatever the box
+    size_t population() const { return total; }
+    // the cells inside the box of the last seek
+    void get_cells(std::vector<Cell> &cells) const;
+    // Only the cells inside this box as well, without walking the rest
+    void get_cells(std::vector<Cell> &cells, int32_t min_x, int32_t min_y,
+                   int32_t max_x, int32_t max_y) const;
+
+private:
+    // inclusive and signed, the whole plane by default
+    struct Box {
+        int32_t min_x = INT32_MIN, min_y = INT32_MIN;
+        int32_t max_x = INT32_MAX, max_y = INT32_MAX;
+
+        bool operator==(const Box &other) const {
+            return min_x == other.min_x && min_y == other.min_y &&
+                   max_x == other.max_x && max_y == other.max_y;
+        }
+    };
+
+    uint64_t seek(uint64_t target, const Box &view);
+
+    const History &history;
+    bool valid = false;
+    uint64_t at = 0;
+    size_t total = 0;
+    Box box;
+    History::Keys keys, scratch, merged, births, deaths;
+};
+
+#endif // HISTORY_HPP
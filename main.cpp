@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "checkpoint.hpp"
+#include "cycle.hpp"
+#ifdef FAST_LIFE_VIEWER
+#include "gl_utils.hpp"
+#endif
+#include "metrics.hpp"
+#include "game.hpp"
+#include "engine.hpp"
+#include "rle.hpp"
+#include "shard.hpp"
+#include "term_render.hpp"
+
+struct Options {
+    std::string pattern = "2c5-spaceship-gun-p416.txt";
+    std::string engine = "set";
+    bool engine_given = false;
+    int threads = std::thread::hardware_concurrency();
+    bool term = false;
+    bool headless = false;
+    uint64_t generations = 1000;
+    std::string save;
+    std::string rule;
+    TermOptions term_opts;
+    std::string checkpoint;
+    uint64_t checkpoint_every = 0;
+    bool resume = false;
+    std::string metrics;
+    MetricsFormat metrics_format = METRICS_CSV;
+    ShardOptions shard_opts;
+};
+
+void usage(const char *prog) {
+    std::cerr << "usage: " << prog << " [pattern.rle] [--engine name]"
+              << " [--threads n] [--term | --headless] [--generations n]"
+              << " [--save out.rle] [--rule B3/S23]"
+              << " [--fps n] [--gps n] [--blocks]"
+              << " [--checkpoint file] [--checkpoint-every n] [--resume]"
+              << " [--metrics file|-|unix:path] [--metrics-format csv|json]"
+              << " [--cycles stop|skip]"
+              << " [--shards n | --shard-rank r --shard-hosts host:port,...]"
+              << " [--rebalance-every n] [--gather]" << std::endl;
+}
+
+// Takes our own flags out of argv and leaves the rest for glutInit
+bool parse_options(int &argc, char** argv, Options &opts) {
+    int out = 1;
+    bool have_pattern = false;
+
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if(arg == "--engine" && has_value){
+            opts.engine = argv[++i];
+            opts.engine_given = true;
+        }
+        else if(arg == "--threads" && has_value) opts.threads = atoi(argv[++i]);
+        else if(arg == "--generations" && has_value) opts.generations = strtoull(argv[++i], nullptr, 10);
+        else if(arg == "--save" && has_value) opts.save = argv[++i];
+        else if(arg == "--rule" && has_value) opts.rule = argv[++i];
+        else if(arg == "--fps" && has_value) opts.term_opts.fps = atoi(argv[++i]);
+        else if(arg == "--gps" && has_value) opts.term_opts.gps = atof(argv[++i]);
+        else if(arg == "--blocks") opts.term_opts.half_blocks = true;
+        else if(arg == "--checkpoint" && has_value) opts.checkpoint = argv[++i];
+        else if(arg == "--checkpoint-every" && has_value) opts.checkpoint_every = strtoull(argv[++i], nullptr, 10);
+        else if(arg == "--resume") opts.resume = true;
+        else if(arg == "--metrics" && has_value) opts.metrics = argv[++i];
+        else if(arg == "--metrics-format" && has_value) {
+            opts.metrics_format = std::string(argv[++i]) == "json" ? METRICS_JSON : METRICS_CSV;
+        }
+        else if(arg == "--cycles" && has_value) {
+            std::string action = argv[++i];
+            if(action == "stop") opts.term_opts.cycles = CYCLES_STOP;
+            else if(action == "skip") opts.term_opts.cycles = CYCLES_SKIP;
+            else return false;
+        }
+        else if(arg == "--shards" && has_value) opts.shard_opts.shards = atoi(argv[++i]);
+        else if(arg == "--shard-rank" && has_value) opts.shard_opts.rank = atoi(argv[++i]);
+        else if(arg == "--shard-hosts" && has_value) {
+            std::string hosts = argv[++i];
+            for(size_t start = 0; start <= hosts.size();){
+                size_t comma = std::min(hosts.find(',', start), hosts.size());
+                if(comma > start) opts.shard_opts.hosts.push_back(hosts.substr(start, comma - start));
+                start = comma + 1;
+            }
+        }
+        else if(arg == "--rebalance-every" && has_value) opts.shard_opts.rebalance_every = strtoull(argv[++i], nullptr, 10);
+        else if(arg == "--gather") opts.shard_opts.gather = true;
+        else if(arg == "--term") opts.term = true;
+        else if(arg == "--headless") opts.headless = true;
+        else if(arg == "--help" || arg == "-h") return false;
+        else if(arg[0] != '-' && !have_pattern){
+            opts.pattern = arg;
+            have_pattern = true;
+        }
+        else argv[out++] = argv[i];
+    }
+
+    argc = out;
+    return true;
+}
+
+bool sharded(const Options &opts) {
+    return opts.shard_opts.shards > 1 || !opts.shard_opts.hosts.empty();
+}
+
+// Shards always step with the tile engine and only ever load, step and
+// save, so anything else asked of them is an error rather than ignored
+bool check_shard_options(const Options &opts) {
+    std::string clash;
+    if (!opts.headless) clash = "--term or the window (add --headless)";
+    else if (opts.engine_given && opts.engine != "tile") clash = "--engine " + opts.engine;
+    else if (!opts.checkpoint.empty() || opts.checkpoint_every > 0 || opts.resume)
+        clash = "--checkpoint, --checkpoint-every or --resume";
+    else if (opts.term_opts.cycles != CYCLES_OFF) clash = "--cycles";
+    else if (!opts.metrics.empty()) clash = "--metrics";
+
+    if (clash.empty()) return true;
+    std::cerr << "Sharded runs don't support " << clash << std::endl;
+    return false;
+}
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void request_stop(int) { stop_requested = 1; }
+
+// Generations per advance() while checkpointing: doubled while a call
+// comes back quickly, so HashLife still gets big jumps and the engines that
+// step one at a time still notice ctrl-c within a fraction of a second.
+uint64_t next_chunk(uint64_t chunk, std::chrono::steady_clock::duration took) {
+    if (took < std::chrono::milliseconds(50)) return std::min(chunk * 2, (uint64_t)1 << 62);
+    if (took > std::chrono::milliseconds(200)) return std::max<uint64_t>(chunk / 2, 1);
+    return chunk;
+}
+
+// Runs up to opts.generations, checkpointing every checkpoint_every
+// generations on the side. With --checkpoint, ctrl-c or a kill stops soon
+// after and leaves a checkpoint to --resume from. With --cycles the run
+// ends (or jumps to the end) once the board repeats.
+bool run_headless(Engine &engine, const Options &opts, uint64_t &generation) {
+    if (opts.checkpoint.empty() && opts.term_opts.cycles == CYCLES_OFF) {
+        if (generation < opts.generations) engine.advance(opts.generations - generation);
+        generation = std::max(generation, opts.generations);
+        return true;
+    }
+
+    std::unique_ptr<CheckpointWriter> writer;
+    if (!opts.checkpoint.empty()) {
+        std::signal(SIGINT, request_stop);
+        std::signal(SIGTERM, request_stop);
+        writer = std::make_unique<CheckpointWriter>(opts.checkpoint);
+    }
+
+    CycleDetector cycles;
+    bool watch = opts.term_opts.cycles != CYCLES_OFF;
+    if (watch) cycles.observe(engine, generation);
+
+    // the cycle detector has to see every generation
+    uint64_t chunk = 1;
+    uint64_t last_saved = generation;
+    while (generation < opts.generations && !stop_requested) {
+        uint64_t n = watch ? 1 : std::min(chunk, opts.generations - generation);
+        uint64_t due = last_saved + opts.checkpoint_every;
+        if (opts.checkpoint_every > 0 && due > generation) n = std::min(n, due - generation);
+
+        auto started = std::chrono::steady_clock::now();
+        engine.advance(n);
+        generation += n;
+        if (!watch) chunk = next_chunk(chunk, std::chrono::steady_clock::now() - started);
+
+        if (watch && cycles.observe(engine, generation)) {
+            print_cycle(std::cout, cycles.cycle());
+            if (opts.term_opts.cycles == CYCLES_SKIP) {
+                generation = fast_forward(engine, cycles.cycle(), generation, opts.generations);
+            }
+            break;
+        }
+
+        // a checkpoint that's still being written just pushes this one
+        // back a little
+        if (writer && opts.checkpoint_every > 0 &&
+            generation - last_saved >= opts.checkpoint_every &&
+            writer->submit(engine, generation)) {
+            last_saved = generation;
+        }
+    }
+
+    if (!writer) return true;
+
+    writer->wait();
+    writer->submit(engine, generation);
+    if (!writer->wait()) {
+        std::cerr << "Error writing checkpoint: " << opts.checkpoint << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    if (!parse_options(argc, argv, opts)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (sharded(opts)) {
+        if (!check_shard_options(opts)) return 1;
+        Rule rule;
+        if (!opts.rule.empty() && !parse_rule(opts.rule, rule)) {
+            std::cerr << "Unsupported rule: " << opts.rule << std::endl;
+            return 1;
+        }
+        std::string path = find_pattern_file(opts.pattern);
+        if (path.empty()) {
+            std::cerr << "Error opening file: " << opts.pattern << std::endl;
+            return 1;
+        }
+
+        // each rank loads its own band, so the pattern never goes through
+        // an engine here
+        ShardOptions shard_opts = opts.shard_opts;
+        shard_opts.save = opts.save;
+        ShardResult result;
+        if (!run_sharded(path, 1, 1, opts.rule, opts.generations, shard_opts, result)) {
+            std::cerr << "Sharded run failed" << std::endl;
+            return 1;
+        }
+        if (result.root) {
+            std::cout << "generation " << opts.generations
+                      << " population " << result.population << std::endl;
+        }
+        return 0;
+    }
+
+    if (!opts.metrics.empty() && !metrics_open(opts.metrics, opts.metrics_format)) {
+#ifdef FAST_LIFE_METRICS
+        std::cerr << "Error opening metrics output: " << opts.metrics << std::endl;
+#else
+        std::cerr << "--metrics needs a build with -DFAST_LIFE_METRICS=ON" << std::endl;
+#endif
+        return 1;
+    }
+
+    std::unique_ptr<Engine> engine = make_engine(opts.engine, opts.threads);
+    if (!engine) {
+        std::cerr << "Unknown engine: " << opts.engine << " (try";
+        for (const std::string &name : engine_names()) {
+            std::cerr << " " << name;
+        }
+        std::cerr << ")" << std::endl;
+        return 1;
+    }
+
+    // --resume picks up from the checkpoint when there is one, the pattern
+    // is only a fallback for the first run. A checkpoint that's there but
+    // won't load is an error, starting over would write on top of it.
+    CheckpointInfo resumed;
+    bool have_checkpoint = opts.resume && !opts.checkpoint.empty() &&
+                           std::ifstream(opts.checkpoint).is_open();
+    if (have_checkpoint && !load_checkpoint(opts.checkpoint, *engine, &resumed)) {
+        std::cerr << "Error loading checkpoint: " << opts.checkpoint
+                  << " (remove it to start from the pattern)" << std::endl;
+        return 1;
+    }
+
+    RleHeader header;
+    if (have_checkpoint) {
+        std::cerr << "Resuming " << opts.checkpoint << " at generation "
+                  << resumed.generation << std::endl;
+    } else {
+        std::string path = find_pattern_file(opts.pattern);
+        if (path.empty() || !load_rle_file(path, *engine, 1, 1, &header)) {
+            std::cerr << "Error opening file: " << opts.pattern << std::endl;
+            return 1;
+        }
+    }
+
+    // --rule beats the file's own rule = field
+    std::string rule_text = opts.rule.empty() ? header.rule : opts.rule;
+    if (!rule_text.empty()) {
+        Rule rule;
+        if (!parse_rule(rule_text, rule)) {
+            std::cerr << "Unsupported rule: " << rule_text << std::endl;
+            return 1;
+        }
+        engine->set_rule(rule);
+    }
+
+    if (opts.headless || opts.term) {
+        if (opts.headless) {
+            uint64_t generation = have_checkpoint ? resumed.generation : 0;
+            if (!run_headless(*engine, opts, generation)) {
+                return 1;
+            }
+            std::cout << "generation " << generation
+                      << " population " << engine->population();
+            // only the engines that skip settled tiles report these
+            if (engine->active_tiles() > 0) {
+                std::cout << " active tiles " << engine->active_tiles();
+            }
+            std::cout << std::endl;
+        } else {
+            int iterations = (int)std::min<uint64_t>(opts.generations, INT_MAX);
+            print_to_term(*engine, iterations, opts.term_opts);
+        }
+        metrics_close();
+
+        if (!opts.save.empty() && !write_rle_file(opts.save, *engine)) {
+            std::cerr << "Error writing file: " << opts.save << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+#ifdef FAST_LIFE_VIEWER
+    init_window(argc,  argv, std::move(engine));
+    return 0;
+#else
+    std::cerr << "Built without OpenGL/GLUT, there's no window:"
+              << " use --headless or --term" << std::endl;
+    return 1;
+#endif
+}
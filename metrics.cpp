@@ -0,0 +1,215 @@
+#include "metrics.hpp"
+
+#ifdef FAST_LIFE_METRICS
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "engine.hpp"
+
+static FILE *sink = nullptr;
+static MetricsFormat sink_format = METRICS_CSV;
+static bool header_written = false;
+static uint64_t generations_done = 0;
+
+// The tile engine's box scans every row of every tile, a good fraction of
+// a step, so it's only refreshed every BOX_EVERY generations
+static const uint64_t BOX_EVERY = 16;
+static int32_t box[4] = {0, 0, -1, -1};
+static uint64_t box_generation = 0;
+static bool box_valid = false;
+
+// Everything below is added to from any thread and drained by
+// metrics_end_generation on the stepping thread
+static std::atomic<uint64_t> phase_ns[PHASE_COUNT];
+static std::atomic<uint64_t> counters[COUNTER_COUNT];
+static std::atomic<uint64_t> busy_ns[METRICS_MAX_WORKERS];
+static std::atomic<int> workers_seen{0};
+
+// Allocation counts live in per-thread slots so the hot path in operator
+// new isn't every thread hammering one cache line
+struct alignas(64) AllocSlot {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> bytes{0};
+};
+static AllocSlot alloc_slots[METRICS_MAX_WORKERS];
+static std::atomic<int> next_alloc_slot{0};
+static thread_local int alloc_slot = -1;
+
+void metrics_count_alloc(size_t size) {
+    if(alloc_slot < 0) {
+        alloc_slot = std::min(next_alloc_slot.fetch_add(1), METRICS_MAX_WORKERS - 1);
+    }
+    AllocSlot &slot = alloc_slots[alloc_slot];
+    slot.count.fetch_add(1, std::memory_order_relaxed);
+    slot.bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+static void drain_allocs(uint64_t &count, uint64_t &bytes) {
+    count = bytes = 0;
+    for(AllocSlot &slot : alloc_slots) {
+        count += slot.count.exchange(0, std::memory_order_relaxed);
+        bytes += slot.bytes.exchange(0, std::memory_order_relaxed);
+    }
+}
+
+uint64_t metrics_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void metrics_add_phase(MetricsPhase phase, uint64_t ns) {
+    phase_ns[phase].fetch_add(ns, std::memory_order_relaxed);
+}
+
+void metrics_add_counter(MetricsCounter counter, uint64_t n) {
+    counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+void metrics_add_busy(int worker, uint64_t ns) {
+    worker = std::min(worker, METRICS_MAX_WORKERS - 1);
+    busy_ns[worker].fetch_add(ns, std::memory_order_relaxed);
+
+    int seen = workers_seen.load(std::memory_order_relaxed);
+    while(seen <= worker && !workers_seen.compare_exchange_weak(seen, worker + 1)) {}
+}
+
+bool metrics_open(const std::string &target, MetricsFormat format) {
+    metrics_close();
+
+    if(target == "-") {
+        sink = stdout;
+    } else if(target.compare(0, 5, "unix:") == 0) {
+        std::string path = target.substr(5);
+        struct sockaddr_un addr = {};
+        if(path.size() >= sizeof(addr.sun_path)) return false;
+        addr.sun_family = AF_UNIX;
+        path.copy(addr.sun_path, path.size());
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd < 0) return false;
+        if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+           !(sink = fdopen(fd, "w"))) {
+            close(fd);
+            return false;
+        }
+        // a reader going away shouldn't take the run down with it
+        signal(SIGPIPE, SIG_IGN);
+        setvbuf(sink, nullptr, _IOLBF, 0);
+    } else {
+        sink = fopen(target.c_str(), "w");
+        if(!sink) return false;
+    }
+
+    sink_format = format;
+    header_written = false;
+    box_valid = false;
+    return true;
+}
+
+void metrics_close() {
+    if(!sink) return;
+    if(sink == stdout) fflush(sink);
+    else fclose(sink);
+    sink = nullptr;
+}
+
+bool metrics_enabled() { return sink != nullptr; }
+
+static double us(uint64_t ns) { return ns / 1000.0; }
+
+static const char *PHASE_NAMES[PHASE_COUNT] = {
+    "candidates_us", "compute_us", "parallel_us", "merge_us", "gc_us",
+};
+
+void metrics_end_generation(const Engine &engine, uint64_t generations, uint64_t ns) {
+    uint64_t phases[PHASE_COUNT], counts[COUNTER_COUNT];
+    for(int i = 0; i < PHASE_COUNT; i++) phases[i] = phase_ns[i].exchange(0);
+    for(int i = 0; i < COUNTER_COUNT; i++) counts[i] = counters[i].exchange(0);
+
+    int workers = workers_seen.exchange(0);
+    uint64_t busy[METRICS_MAX_WORKERS];
+    for(int i = 0; i < METRICS_MAX_WORKERS; i++) busy[i] = busy_ns[i].exchange(0);
+
+    uint64_t allocs, alloc_bytes;
+    drain_allocs(allocs, alloc_bytes);
+
+    generations_done += generations;
+    if(!sink) return;
+
+    if(!box_valid || generations_done - box_generation >= BOX_EVERY) {
+        box[0] = box[1] = 0;
+        box[2] = box[3] = -1;
+        engine.bounding_box(box[0], box[1], box[2], box[3]);
+        box_generation = generations_done;
+        box_valid = true;
+    }
+    int32_t min_x = box[0], min_y = box[1], max_x = box[2], max_y = box[3];
+
+    // slowest worker over the average, 1.0 is perfectly even
+    uint64_t busy_max = 0, busy_sum = 0;
+    for(int i = 0; i < workers; i++) {
+        busy_max = std::max(busy_max, busy[i]);
+        busy_sum += busy[i];
+    }
+    double imbalance = busy_sum ? (double)busy_max * workers / busy_sum : 1.0;
+
+    auto idle = [&](int w) {
+        return phases[PHASE_PARALLEL] > busy[w] ? phases[PHASE_PARALLEL] - busy[w] : 0;
+    };
+
+    if(sink_format == METRICS_CSV) {
+        if(!header_written) {
+            fprintf(sink, "generation,engine,generations,total_us");
+            for(const char *name : PHASE_NAMES) fprintf(sink, ",%s", name);
+            fprintf(sink, ",population,candidates,active,allocs,alloc_bytes,"
+                          "min_x,min_y,max_x,max_y,imbalance,busy_us,idle_us\n");
+            header_written = true;
+        }
+
+        fprintf(sink, "%llu,%s,%llu,%.1f", (unsigned long long)generations_done,
+                engine.name(), (unsigned long long)generations, us(ns));
+        for(uint64_t p : phases) fprintf(sink, ",%.1f", us(p));
+        fprintf(sink, ",%zu,%llu,%llu,%llu,%llu,%d,%d,%d,%d,%.3f,",
+                engine.population(), (unsigned long long)counts[COUNTER_CANDIDATES],
+                (unsigned long long)counts[COUNTER_ACTIVE], (unsigned long long)allocs,
+                (unsigned long long)alloc_bytes, min_x, min_y, max_x, max_y, imbalance);
+
+        // per worker lists, space separated inside one column
+        for(int i = 0; i < workers; i++) fprintf(sink, i ? " %.1f" : "%.1f", us(busy[i]));
+        fputc(',', sink);
+        for(int i = 0; i < workers; i++) fprintf(sink, i ? " %.1f" : "%.1f", us(idle(i)));
+        fputc('\n', sink);
+    } else {
+        fprintf(sink, "{\"generation\":%llu,\"engine\":\"%s\",\"generations\":%llu,\"total_us\":%.1f",
+                (unsigned long long)generations_done, engine.name(),
+                (unsigned long long)generations, us(ns));
+        for(int i = 0; i < PHASE_COUNT; i++) fprintf(sink, ",\"%s\":%.1f", PHASE_NAMES[i], us(phases[i]));
+        fprintf(sink, ",\"population\":%zu,\"candidates\":%llu,\"active\":%llu,"
+                      "\"allocs\":%llu,\"alloc_bytes\":%llu,\"bbox\":[%d,%d,%d,%d],\"imbalance\":%.3f",
+                engine.population(), (unsigned long long)counts[COUNTER_CANDIDATES],
+                (unsigned long long)counts[COUNTER_ACTIVE], (unsigned long long)allocs,
+                (unsigned long long)alloc_bytes, min_x, min_y, max_x, max_y, imbalance);
+
+        fprintf(sink, ",\"busy_us\":[");
+        for(int i = 0; i < workers; i++) fprintf(sink, i ? ",%.1f" : "%.1f", us(busy[i]));
+        fprintf(sink, "],\"idle_us\":[");
+        for(int i = 0; i < workers; i++) fprintf(sink, i ? ",%.1f" : "%.1f", us(idle(i)));
+        fprintf(sink, "]}\n");
+    }
+
+    // whatever printing allocated isn't the engine's
+    drain_allocs(allocs, alloc_bytes);
+
+    // the reader hung up or the disk filled, keep stepping without us
+    if(ferror(sink)) metrics_close();
+}
+
+#endif // FAST_LIFE_METRICS
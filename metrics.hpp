@@ -0,0 +1,103 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class Engine;
+
+// Per-generation instrumentation. Build with -DFAST_LIFE_METRICS=ON and the
+// engines time their phases, the pool times each worker, and every
+// generation becomes one CSV or JSON line on whatever metrics_open()
+// pointed at. Without it every METRICS_* macro is empty and none of this is
+// compiled in.
+//
+// Allocations are only counted in binaries that also link
+// metrics_alloc.cpp, which replaces operator new. The library leaves the
+// allocator alone, so the bench and census keep the real one.
+
+enum MetricsPhase {
+    PHASE_CANDIDATES, // finding cells/tiles that can change (summed over workers)
+    PHASE_COMPUTE,    // neighbour counting and the rule (summed over workers)
+    PHASE_PARALLEL,   // wall time inside ThreadPool::parallel_for
+    PHASE_MERGE,      // freeing old set bands / swapping tile maps
+    PHASE_GC,         // hashlife garbage collection
+    PHASE_COUNT
+};
+
+enum MetricsCounter {
+    COUNTER_CANDIDATES, // cells or tiles looked at
+    COUNTER_ACTIVE,     // tiles actually recomputed
+    COUNTER_COUNT
+};
+
+// Max workers tracked separately, later ones share the last slot
+const int METRICS_MAX_WORKERS = 64;
+
+enum MetricsFormat { METRICS_CSV, METRICS_JSON };
+
+#ifdef FAST_LIFE_METRICS
+
+// target is a file path, "-" for stdout or "unix:/path" for a listening
+// unix stream socket. Returns false if it can't be opened.
+bool metrics_open(const std::string &target, MetricsFormat format);
+void metrics_close();
+bool metrics_enabled();
+
+uint64_t metrics_now_ns();
+void metrics_add_phase(MetricsPhase phase, uint64_t ns);
+void metrics_add_counter(MetricsCounter counter, uint64_t n);
+void metrics_add_busy(int worker, uint64_t ns);
+// called by the replacement operator new in metrics_alloc.cpp
+void metrics_count_alloc(size_t size);
+void metrics_end_generation(const Engine &engine, uint64_t generations, uint64_t ns);
+
+// Brackets one call to step()/advance(), the record goes out when it ends
+class MetricsGeneration {
+public:
+    MetricsGeneration(const Engine &engine, uint64_t generations)
+        : engine(engine), generations(generations), start(metrics_now_ns()) {}
+    ~MetricsGeneration() {
+        metrics_end_generation(engine, generations, metrics_now_ns() - start);
+    }
+
+private:
+    const Engine &engine;
+    uint64_t generations;
+    uint64_t start;
+};
+
+// Time one worker spends inside tasks, the rest of parallel_for is idle
+class MetricsBusy {
+public:
+    explicit MetricsBusy(int worker) : worker(worker), start(metrics_now_ns()) {}
+    ~MetricsBusy() { metrics_add_busy(worker, metrics_now_ns() - start); }
+
+private:
+    int worker;
+    uint64_t start;
+};
+
+// METRICS_BEGIN(PHASE_X) ... METRICS_END(PHASE_X) in the same scope
+#define METRICS_BEGIN(phase) uint64_t metrics_start_##phase = metrics_now_ns()
+#define METRICS_END(phase) metrics_add_phase(phase, metrics_now_ns() - metrics_start_##phase)
+#define METRICS_GENERATION(engine, n) MetricsGeneration metrics_generation(engine, n)
+#define METRICS_BUSY(worker) MetricsBusy metrics_busy(worker)
+#define METRICS_COUNT(counter, n) metrics_add_counter(counter, n)
+
+#else
+
+inline bool metrics_open(const std::string &, MetricsFormat) { return false; }
+inline void metrics_close() {}
+inline bool metrics_enabled() { return false; }
+
+#define METRICS_BEGIN(phase) ((void)0)
+#define METRICS_END(phase) ((void)0)
+#define METRICS_GENERATION(engine, n) ((void)0)
+#define METRICS_BUSY(worker) ((void)0)
+#define METRICS_COUNT(counter, n) ((void)0)
+
+#endif // FAST_LIFE_METRICS
+
+#endif // METRICS_HPP
@@ -0,0 +1,26 @@
+#include <cstdlib>
+#include <new>
+
+#include "metrics.hpp"
+
+// Counting operator new for metrics builds, see metrics.hpp. Only the
+// viewer links this, never the fast_life library.
+
+#ifdef FAST_LIFE_METRICS
+
+void *operator new(size_t size) {
+    metrics_count_alloc(size);
+    if(void *p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+#endif // FAST_LIFE_METRICS
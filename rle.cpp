@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FAST_LIFE_HAVE_MMAP 1
+#endif
+
+#include "rle.hpp"
+#include "engine.hpp"
+
+static const size_t READ_CHUNK = 1 << 20;
+static const unsigned RLE_LINE_WIDTH = 70;
+
+static std::string trim(const std::string &s) {
+    size_t b = s.find_first_not_of(" \t\r");
+    if(b == std::string::npos) return "";
+    size_t e = s.find_last_not_of(" \t\r");
+    return s.substr(b, e - b + 1);
+}
+
+RleParser::RleParser(unsigned x0, unsigned y0, RunFn add_run)
+    : add_run(std::move(add_run)), x0(x0), y0(y0), x(x0), y(y0) {}
+
+void RleParser::finish_line() {
+    if(mode == COMMENT) {
+        head.comments.push_back(line);
+
+        int px, py;
+        if(!seen_data && sscanf(line.c_str(), "CXRLE Pos=%d,%d", &px, &py) == 2) {
+            head.has_pos = true;
+            head.pos_x = px;
+            head.pos_y = py;
+            x = x0 = (unsigned)px;
+            y = y0 = (unsigned)py;
+        }
+    } else if(mode == HEADER) {
+        // x = 12, y = 3, rule = B3/S23
+        size_t start = 0;
+        while(start <= line.size()) {
+            size_t comma = line.find(',', start);
+            if(comma == std::string::npos) comma = line.size();
+
+            std::string field = line.substr(start, comma - start);
+            size_t eq = field.find('=');
+            if(eq != std::string::npos) {
+                std::string key = trim(field.substr(0, eq));
+                std::string value = trim(field.substr(eq + 1));
+
+                if(key == "x") head.width = strtoul(value.c_str(), nullptr, 10);
+                else if(key == "y") head.height = strtoul(value.c_str(), nullptr, 10);
+                else if(key == "rule") head.rule = value;
+            }
+            start = comma + 1;
+        }
+    }
+
+    line.clear();
+    mode = DATA;
+    line_start = true;
+}
+
+bool RleParser::feed(const char *p, const char *end) {
+    while(p < end && !done) {
+        if(mode != DATA) {
+            const char *nl = (const char *)memchr(p, '\n', end - p);
+            line.append(p, nl ? nl : end);
+            if(!nl) return true;
+
+            finish_line();
+            p = nl + 1;
+            continue;
+        }
+
+        char ch = *p;
+
+        if(line_start) {
+            if(ch == ' ' || ch == '\t' || ch == '\r') {
+                p++;
+                continue;
+            }
+            line_start = false;
+
+            if(ch == '#') {
+                mode = COMMENT;
+                p++;
+                continue;
+            }
+            if(ch == 'x' && !seen_data) {
+                mode = HEADER;
+                continue;
+            }
+        }
+
+        if(ch >= '0' && ch <= '9') {
+            count = count * 10 + (ch - '0');
+            if(count > UINT32_MAX) return false;
+            p++;
+            continue;
+        }
+
+        unsigned n = count ? (unsigned)count : 1;
+        switch(ch) {
+            case 'b':
+            case '.':
+                x += n;
+                break;
+            case 'o':
+                add_run(x, y, n);
+                x += n;
+                seen_data = true;
+                break;
+            case '$':
+                y += n;
+                x = x0;
+                seen_data = true;
+                break;
+            case '!':
+                done = true;
+                break;
+            case '\n':
+                line_start = true;
+                break;
+            default:
+                // multi-state letters count as alive, anything else is noise
+                if(ch >= 'A' && ch <= 'X') {
+                    add_run(x, y, n);
+                    x += n;
+                    seen_data = true;
+                }
+                break;
+        }
+
+        if(ch != ' ' && ch != '\t' && ch != '\r' && ch != '\n') count = 0;
+        p++;
+    }
+
+    return true;
+}
+
+void RleParser::flush() {
+    // a trailing header or comment line with no newline
+    if(mode != DATA) finish_line();
+}
+
+bool parse_rle_file(const std::string &path, unsigned x0, unsigned y0,
+                    const RleParser::RunFn &add_run, RleHeader *header) {
+
+    RleParser parser(x0, y0, add_run);
+
+#ifdef FAST_LIFE_HAVE_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+
+    struct stat st;
+    void *data = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if(data != MAP_FAILED) {
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+        const char *text = (const char *)data;
+        bool ok = parser.feed(text, text + st.st_size);
+        parser.flush();
+        munmap(data, st.st_size);
+
+        if(header) *header = parser.header();
+        return ok;
+    }
+#endif
+
+    FILE *file = fopen(path.c_str(), "rb");
+    if(!file) return false;
+
+    std::vector<char> chunk(READ_CHUNK);
+    bool ok = true;
+    while(ok && !parser.finished()) {
+        size_t got = fread(chunk.data(), 1, chunk.size(), file);
+        if(got == 0) break;
+        ok = parser.feed(chunk.data(), chunk.data() + got);
+    }
+    parser.flush();
+    fclose(file);
+
+    if(header) *header = parser.header();
+    return ok;
+}
+
+bool load_rle_file(const std::string &path, Engine &engine,
+                   unsigned x0, unsigned y0, RleHeader *header) {
+    engine.clear();
+    bool ok = parse_rle_file(path, x0, y0, [&](unsigned x, unsigned y, unsigned length) {
+        engine.add_run(x, y, length);
+    }, header);
+    engine.commit();
+    return ok;
+}
+
+// cells as (y, x), sorted row major
+static bool write_rows(FILE *out, const std::vector<std::pair<int32_t, int32_t>> &cells,
+                       const std::string &rule) {
+    int32_t min_x = 0, max_x = 0, min_y = 0, max_y = 0;
+    if(!cells.empty()) {
+        min_y = cells.front().first;
+        max_y = cells.back().first;
+        min_x = max_x = cells.front().second;
+        for(const auto &[cy, cx] : cells) {
+            min_x = std::min(min_x, cx);
+            max_x = std::max(max_x, cx);
+        }
+    }
+
+    unsigned width = cells.empty() ? 0 : (unsigned)(max_x - min_x) + 1;
+    unsigned height = cells.empty() ? 0 : (unsigned)(max_y - min_y) + 1;
+    fprintf(out, "#CXRLE Pos=%d,%d\n", min_x, min_y);
+    fprintf(out, "x = %u, y = %u, rule = %s\n", width, height, rule.c_str());
+
+    std::string body, line;
+    body.reserve(cells.size() * 2);
+
+    auto emit = [&](unsigned n, char tag) {
+        char token[16];
+        int len = n > 1 ? snprintf(token, sizeof(token), "%u%c", n, tag)
+                        : snprintf(token, sizeof(token), "%c", tag);
+        if(line.size() + len > RLE_LINE_WIDTH) {
+            body += line;
+            body += '\n';
+            line.clear();
+        }
+        line.append(token, len);
+    };
+
+    int32_t row = min_y;
+    size_t i = 0;
+    while(i < cells.size()) {
+        int32_t y = cells[i].first;
+        if(y != row) {
+            emit((unsigned)(y - row), '$');
+            row = y;
+        }
+
+        int32_t x = min_x;
+        while(i < cells.size() && cells[i].first == y) {
+            int32_t start = cells[i].second;
+            int32_t end = start;
+            i++;
+            while(i < cells.size() && cells[i].first == y &&
+                  cells[i].second == end + 1) {
+                end++;
+                i++;
+            }
+
+            if(start > x) emit((unsigned)(start - x), 'b');
+            emit((unsigned)(end - start) + 1, 'o');
+            x = end + 1;
+        }
+    }
+    emit(1, '!');
+    body += line;
+    body += '\n';
+
+    return fwrite(body.data(), 1, body.size(), out) == body.size();
+}
+
+bool write_rle(FILE *out, const Board &board, const std::string &rule) {
+    // RLE is row major, Board is column major
+    std::vector<std::pair<int32_t, int32_t>> cells;
+    cells.reserve(board.size());
+    for(const Cell &c : board) {
+        cells.push_back({(int32_t)c.second, (int32_t)c.first});
+    }
+    std::sort(cells.begin(), cells.end());
+    return write_rows(out, cells, rule);
+}
+
+bool write_rle_file(const std::string &path, const Board &board,
+                    const std::string &rule) {
+    FILE *out = fopen(path.c_str(), "wb");
+    if(!out) return false;
+
+    bool ok = write_rle(out, board, rule);
+    return fclose(out) == 0 && ok;
+}
+
+bool write_rle_file(const std::string &path, const Engine &engine) {
+    std::vector<std::pair<int32_t, int32_t>> cells;
+    {
+        std::vector<Cell> live;
+        engine.get_cells(live);
+        cells.reserve(live.size());
+        for(const Cell &c : live) cells.push_back({(int32_t)c.second, (int32_t)c.first});
+    }
+    std::sort(cells.begin(), cells.end());
+
+    FILE *out = fopen(path.c_str(), "wb");
+    if(!out) return false;
+
+    bool ok = write_rows(out, cells, engine.get_rule().str());
+    return fclose(out) == 0 && ok;
+}
@@ -0,0 +1,85 @@
+#ifndef RLE_HPP
+#define RLE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "game.hpp"
+
+class Engine;
+
+struct RleHeader {
+    // 0 when the file has no "x = , y = " line
+    unsigned width = 0;
+    unsigned height = 0;
+    std::string rule;
+    std::vector<std::string> comments;
+
+    // from a Golly style "#CXRLE Pos=x,y" comment
+    bool has_pos = false;
+    int32_t pos_x = 0;
+    int32_t pos_y = 0;
+};
+
+// Incremental RLE parser. Text can be fed in arbitrary chunks (a whole
+// mmapped file or pieces of a stream), counts are parsed in place and every
+// horizontal run of live cells goes straight to add_run, so nothing is ever
+// expanded to single cells unless the target wants that.
+//
+// Handles "#" comment lines, the "x = , y = , rule = " header and stops at
+// "!". A "#CXRLE Pos=" comment overrides the origin passed in, so boards
+// written by write_rle come back where they were.
+class RleParser {
+public:
+    typedef std::function<void(unsigned x, unsigned y, unsigned length)> RunFn;
+
+    RleParser(unsigned x0, unsigned y0, RunFn add_run);
+
+    // false on a malformed or overflowing run count
+    bool feed(const char *p, const char *end);
+    // call once the input has run out
+    void flush();
+
+    bool finished() const { return done; }
+    const RleHeader &header() const { return head; }
+
+private:
+    enum Mode { DATA, COMMENT, HEADER };
+
+    void finish_line();
+
+    RunFn add_run;
+    RleHeader head;
+
+    Mode mode = DATA;
+    std::string line;
+    bool line_start = true;
+    bool seen_data = false;
+    bool done = false;
+
+    unsigned x0, y0, x, y;
+    uint64_t count = 0;
+};
+
+// Every run in the file to add_run. The file is mmapped where possible,
+// read in chunks otherwise.
+bool parse_rle_file(const std::string &path, unsigned x0, unsigned y0,
+                    const RleParser::RunFn &add_run, RleHeader *header = nullptr);
+
+// Loads straight into the engine's own layout: clear(), add_run() per run,
+// commit().
+bool load_rle_file(const std::string &path, Engine &engine,
+                   unsigned x0, unsigned y0, RleHeader *header = nullptr);
+
+// Writes x/y/rule header, a #CXRLE Pos line and 70 column lines
+bool write_rle(FILE *out, const Board &board,
+               const std::string &rule = "B3/S23");
+bool write_rle_file(const std::string &path, const Board &board,
+                    const std::string &rule = "B3/S23");
+// From get_cells() and the engine's rule, skipping the std::set
+bool write_rle_file(const std::string &path, const Engine &engine);
+
+#endif // RLE_HPP
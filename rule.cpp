@@ -0,0 +1,53 @@
+#include <cctype>
+
+#include "rule.hpp"
+
+std::string Rule::str() const {
+    std::string s = "B";
+    for(int n = 0; n <= 8; n++) {
+        if((birth >> n) & 1) s += (char)('0' + n);
+    }
+    s += "/S";
+    for(int n = 0; n <= 8; n++) {
+        if((survive >> n) & 1) s += (char)('0' + n);
+    }
+    return s;
+}
+
+bool parse_rule(const std::string &text, Rule &rule) {
+    std::string s;
+    for(char ch : text) {
+        if(ch == ':') break;
+        if(!isspace((unsigned char)ch)) s += (char)toupper((unsigned char)ch);
+    }
+    if(s.empty()) return false;
+
+    uint16_t birth = 0, survive = 0;
+
+    if(s.find('B') != std::string::npos || s.find('S') != std::string::npos) {
+        uint16_t *target = nullptr;
+        for(char ch : s) {
+            if(ch == 'B') target = &birth;
+            else if(ch == 'S') target = &survive;
+            else if(ch == '/') continue;
+            else if(ch >= '0' && ch <= '8' && target) *target |= 1 << (ch - '0');
+            else return false;
+        }
+    } else {
+        // S/B, e.g. 23/3
+        size_t slash = s.find('/');
+        if(slash == std::string::npos) return false;
+
+        for(size_t i = 0; i < s.size(); i++) {
+            if(i == slash) continue;
+            char ch = s[i];
+            if(ch < '0' || ch > '8') return false;
+            (i < slash ? survive : birth) |= 1 << (ch - '0');
+        }
+    }
+
+    if(birth & 1) return false;
+
+    rule = Rule(birth, survive);
+    return true;
+}
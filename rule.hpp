@@ -0,0 +1,41 @@
+#ifndef RULE_HPP
+#define RULE_HPP
+
+#include <cstdint>
+#include <string>
+
+// Outer totalistic B/S rule. Bit n of birth/survive is set when a dead/live
+// cell with n live neighbours is alive next generation.
+struct Rule {
+    uint16_t birth = 1 << 3;
+    uint16_t survive = (1 << 2) | (1 << 3);
+
+    constexpr Rule() = default;
+    constexpr Rule(uint16_t birth, uint16_t survive)
+        : birth(birth), survive(survive) {}
+
+    bool next(bool alive, int n_count) const {
+        return ((alive ? survive : birth) >> n_count) & 1;
+    }
+
+    bool operator==(const Rule &other) const {
+        return birth == other.birth && survive == other.survive;
+    }
+    bool operator!=(const Rule &other) const { return !(*this == other); }
+
+    // canonical "B3/S23" form
+    std::string str() const;
+};
+
+constexpr Rule CONWAY(1 << 3, (1 << 2) | (1 << 3));
+constexpr Rule HIGHLIFE((1 << 3) | (1 << 6), (1 << 2) | (1 << 3));
+constexpr Rule DAY_AND_NIGHT((1 << 3) | (1 << 6) | (1 << 7) | (1 << 8),
+                             (1 << 3) | (1 << 4) | (1 << 6) | (1 << 7) | (1 << 8));
+constexpr Rule SEEDS(1 << 2, 0);
+
+// Accepts B3/S23, b3/s23, B3S23, S23/B3 and the old 23/3 (S/B) notation.
+// Anything after a ':' (Golly bounded grid suffix) is ignored. Rules with
+// B0 are rejected, every engine here assumes empty space stays empty.
+bool parse_rule(const std::string &text, Rule &rule);
+
+#endif // RULE_HPP
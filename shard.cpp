@@ -0,0 +1,763 @@
+#include "shard.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <chrono>
+#include <thread>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define FAST_LIFE_HAVE_SOCKETS 1
+#endif
+
+#include "rle.hpp"
+#include "tile_engine.hpp"
+
+namespace {
+
+const uint32_t TILE_COLUMNS = TileEngine::TILE_MASK + 1; // around the ring
+
+// Messages are native byte order. The handshake opens with this word, so a
+// neighbour with the other byte order (or something that isn't a shard at
+// all) is turned away before any board data is read.
+const uint32_t WIRE_MAGIC = 0x464c5331; // "FLS1"
+
+// Nothing a shard sends comes near this, even gathering a whole board; a
+// bigger length means the stream is garbage, not a reason to allocate it
+const uint64_t MAX_MESSAGE = (uint64_t)1 << 32;
+
+// A shard's band: `width` tile columns starting at tile column lo
+struct Band {
+    uint32_t lo = 0;
+    uint32_t width = TILE_COLUMNS;
+
+    uint32_t first_x() const { return lo << TileEngine::TILE_SHIFT; }
+    uint32_t last_x() const { return ((lo + width) << TileEngine::TILE_SHIFT) - 1; }
+};
+
+template <typename T>
+void put(Message &m, const T &value) {
+    size_t at = m.size();
+    m.resize(at + sizeof(T));
+    memcpy(m.data() + at, &value, sizeof(T));
+}
+
+// Reads values back out in the order put() wrote them, false once it runs
+// past the end. Counts get checked against left() before anything is
+// sized from them.
+struct Reader {
+    const Message &m;
+    size_t pos = 0;
+
+    size_t left() const { return m.size() - pos; }
+
+    template <typename T>
+    bool get(T &value) {
+        if(m.size() - pos < sizeof(T)) return false;
+        memcpy(&value, m.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+};
+
+void put_column(Message &m, const std::vector<TileEngine::ColumnWord> &words) {
+    put(m, (uint64_t)words.size());
+    for(const auto &[y0, bits] : words) {
+        put(m, y0);
+        put(m, bits);
+    }
+}
+
+bool get_column(Reader &in, std::vector<TileEngine::ColumnWord> &words) {
+    const size_t WORD = sizeof(uint32_t) + sizeof(uint64_t);
+    uint64_t n;
+    if(!in.get(n) || n > in.left() / WORD) return false;
+    words.resize(n);
+    for(auto &[y0, bits] : words) {
+        if(!in.get(y0) || !in.get(bits)) return false;
+    }
+    return true;
+}
+
+void put_blocks(Message &m, const std::vector<CellBlock> &blocks) {
+    put(m, (uint64_t)blocks.size());
+    for(const CellBlock &b : blocks) put(m, b);
+}
+
+bool get_blocks(Reader &in, std::vector<CellBlock> &blocks) {
+    uint64_t n;
+    if(!in.get(n) || n > in.left() / sizeof(CellBlock)) return false;
+    size_t start = blocks.size();
+    blocks.resize(start + n);
+    for(size_t i = start; i < blocks.size(); i++) {
+        if(!in.get(blocks[i])) return false;
+    }
+    return true;
+}
+
+// fn(x, n) for each piece of a run that sits in a single tile column
+template <typename Fn>
+void split_run(uint32_t x, uint32_t length, Fn fn) {
+    while(length) {
+        uint32_t n = std::min(length, TileEngine::TILE_SIZE - (x & (TileEngine::TILE_SIZE - 1)));
+        fn(x, n);
+        x += n;
+        length -= n;
+    }
+}
+
+// Bands cut at live cell quantiles of the starting board, by signed tile
+// column. Every rank counts the same file, so they agree without talking.
+std::vector<Band> initial_bands(const std::map<int32_t, uint64_t> &columns, int shards) {
+    std::vector<int64_t> starts;
+    uint64_t total = 0, seen = 0;
+    for(const auto &[column, cells] : columns) total += cells;
+    auto it = columns.begin();
+    for(int i = 0; i < shards; i++) {
+        int64_t start = starts.empty() ? (columns.empty() ? 0 : it->first) : starts.back() + 1;
+        while(it != columns.end() && seen < total * i / shards) {
+            seen += it->second;
+            ++it;
+        }
+        if(it != columns.end()) start = std::max<int64_t>(start, it->first);
+        starts.push_back(start);
+    }
+
+    std::vector<Band> bands(shards);
+    for(int i = 0; i < shards; i++) {
+        int64_t end = i + 1 < shards ? starts[i + 1] : starts[0] + TILE_COLUMNS;
+        bands[i].lo = (uint32_t)starts[i] & TileEngine::TILE_MASK;
+        bands[i].width = (uint32_t)(end - starts[i]);
+    }
+    return bands;
+}
+
+bool heavier(uint64_t a, uint64_t b) { return a > b + b / 4 + 2; }
+
+// Which way whole columns go across a boundary, from the loads and widths
+// on both sides: -1 left gives to right, 1 right gives to left. Both
+// neighbours call it with the same numbers and get the same answer.
+int rebalance_direction(uint64_t left_load, uint32_t left_width,
+                        uint64_t right_load, uint32_t right_width) {
+    if(heavier(left_load, right_load) && left_width >= 3) return -1;
+    if(heavier(right_load, left_load) && right_width >= 3) return 1;
+    return 0;
+}
+
+// How many columns to hand over from one edge: as many as fit in half the
+// difference, counting empty ones for free. Never more than (width - 1) / 2,
+// so giving from both edges at once still leaves a column.
+uint32_t columns_to_give(const std::vector<CellBlock> &blocks, const Band &band,
+                         bool left_edge, uint64_t need) {
+    std::map<uint32_t, uint64_t> per_column; // by distance from the edge
+    for(const CellBlock &b : blocks) {
+        uint32_t offset = ((b.x0 >> TileEngine::TILE_SHIFT) - band.lo) & TileEngine::TILE_MASK;
+        per_column[left_edge ? offset : band.width - 1 - offset]++;
+    }
+
+    uint64_t moved = 0;
+    uint32_t k = 1;
+    for(const auto &[offset, tiles] : per_column) {
+        if(moved + tiles > need) {
+            k = offset;
+            break;
+        }
+        moved += tiles;
+        k = offset + 1;
+    }
+    return std::min(k, (band.width - 1) / 2);
+}
+
+// --rule if there was one, the file's rule = field if not
+bool pick_rule(const std::string &override_text, const RleHeader &header, Rule &rule) {
+    const std::string &text = override_text.empty() ? header.rule : override_text;
+    rule = CONWAY;
+    if(text.empty() || parse_rule(text, rule)) return true;
+    std::cerr << "Unsupported rule: " << text << std::endl;
+    return false;
+}
+
+// out.rle -> out.3.rle
+std::string rank_path(const std::string &path, int rank) {
+    size_t dot = path.rfind('.');
+    size_t slash = path.find_last_of("/\\");
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash)) dot = path.size();
+    return path.substr(0, dot) + "." + std::to_string(rank) + path.substr(dot);
+}
+
+bool save_board(const std::string &path, const Engine &engine) {
+    if(write_rle_file(path, engine)) return true;
+    std::cerr << "Error writing file: " << path << std::endl;
+    return false;
+}
+
+// What every rank is asked to do
+struct Job {
+    const std::string &path;
+    unsigned x0, y0;
+    const std::string &rule;
+    uint64_t generations;
+    const ShardOptions &opts;
+};
+
+class Shard {
+public:
+    Shard(int rank, int shards, Transport &link) : rank(rank), shards(shards), link(link) {}
+
+    bool handshake();
+    // our band of the pattern, and nothing else
+    bool load(const Job &job);
+    bool run(uint64_t generations, uint64_t rebalance_every);
+    // rank 0 ends up with every shard's blocks
+    bool gather(std::vector<CellBlock> &out);
+    // rank 0 ends up with the sum over all shards
+    bool total_population(uint64_t &total);
+
+    const TileEngine &board() const { return engine; }
+
+private:
+    bool exchange_halos();
+    bool rebalance();
+
+    int rank, shards;
+    Transport &link;
+    TileEngine engine;
+    Band band;
+    std::vector<TileEngine::ColumnWord> words;
+};
+
+bool Shard::handshake() {
+    Message out, from_left, from_right;
+    put(out, WIRE_MAGIC);
+    put(out, (int32_t)rank);
+    put(out, (int32_t)shards);
+    if(!link.exchange(out, out, from_left, from_right)) return false;
+
+    uint32_t left_magic, right_magic;
+    int32_t left_rank, left_shards, right_rank, right_shards;
+    Reader l{from_left}, r{from_right};
+    if(!l.get(left_magic) || !r.get(right_magic)) return false;
+    for(uint32_t magic : {left_magic, right_magic}) {
+        if(magic == __builtin_bswap32(WIRE_MAGIC)) {
+            std::cerr << "shard " << rank << ": a neighbour has the other byte order" << std::endl;
+            return false;
+        }
+        if(magic != WIRE_MAGIC) {
+            std::cerr << "shard " << rank << ": a neighbour isn't speaking the shard protocol" << std::endl;
+            return false;
+        }
+    }
+    if(!l.get(left_rank) || !l.get(left_shards) || !r.get(right_rank) || !r.get(right_shards))
+        return false;
+    return left_shards == shards && right_shards == shards &&
+           left_rank == (rank + shards - 1) % shards && right_rank == (rank + 1) % shards;
+}
+
+// Our edge columns go out, the neighbours' edge columns go in just outside
+// the band, where the step reads them and crop_columns throws them away.
+bool Shard::exchange_halos() {
+    Message to_left, to_right, from_left, from_right;
+    engine.get_column(band.first_x(), words);
+    put_column(to_left, words);
+    engine.get_column(band.last_x(), words);
+    put_column(to_right, words);
+    if(!link.exchange(to_left, to_right, from_left, from_right)) return false;
+
+    Reader l{from_left}, r{from_right};
+    if(!get_column(l, words)) return false;
+    engine.add_column(band.first_x() - 1, words);
+    if(!get_column(r, words)) return false;
+    engine.add_column(band.last_x() + 1, words);
+    return true;
+}
+
+bool Shard::rebalance() {
+    Message out, from_left, from_right;
+    uint64_t load = engine.tile_count();
+    put(out, load);
+    put(out, band.width);
+    if(!link.exchange(out, out, from_left, from_right)) return false;
+
+    uint64_t left_load, right_load;
+    uint32_t left_width, right_width;
+    Reader l{from_left}, r{from_right};
+    if(!l.get(left_load) || !l.get(left_width) || !r.get(right_load) || !r.get(right_width))
+        return false;
+
+    bool give_left = rebalance_direction(left_load, left_width, load, band.width) == 1;
+    bool give_right = rebalance_direction(load, band.width, right_load, right_width) == -1;
+
+    uint32_t k_left = 0, k_right = 0;
+    std::vector<CellBlock> removed, to_left_blocks, to_right_blocks;
+    if(give_left || give_right) {
+        std::vector<CellBlock> blocks;
+        engine.get_blocks(blocks);
+        if(give_left) k_left = columns_to_give(blocks, band, true, (load - left_load) / 2);
+        if(give_right) k_right = columns_to_give(blocks, band, false, (load - right_load) / 2);
+
+        Band old = band;
+        band.lo = (band.lo + k_left) & TileEngine::TILE_MASK;
+        band.width -= k_left + k_right;
+        engine.crop_columns(band.lo, band.width, &removed);
+        for(const CellBlock &b : removed) {
+            uint32_t offset = ((b.x0 >> TileEngine::TILE_SHIFT) - old.lo) & TileEngine::TILE_MASK;
+            (offset < k_left ? to_left_blocks : to_right_blocks).push_back(b);
+        }
+    }
+
+    Message to_left, to_right;
+    put(to_left, k_left);
+    put_blocks(to_left, to_left_blocks);
+    put(to_right, k_right);
+    put_blocks(to_right, to_right_blocks);
+    if(!link.exchange(to_left, to_right, from_left, from_right)) return false;
+
+    // whatever a neighbour gave us sits right next to our band
+    uint32_t k_in;
+    std::vector<CellBlock> incoming;
+    Reader bl{from_left}, br{from_right};
+    if(!bl.get(k_in) || !get_blocks(bl, incoming)) return false;
+    band.lo = (band.lo - k_in) & TileEngine::TILE_MASK;
+    band.width += k_in;
+    if(!br.get(k_in) || !get_blocks(br, incoming)) return false;
+    band.width += k_in;
+
+    for(const CellBlock &b : incoming) engine.add_block(b);
+    engine.commit();
+    engine.crop_columns(band.lo, band.width);
+    return true;
+}
+
+bool Shard::load(const Job &job) {
+    std::map<int32_t, uint64_t> columns;
+    RleHeader header;
+    bool ok = parse_rle_file(job.path, job.x0, job.y0, [&](unsigned x, unsigned, unsigned length) {
+        split_run(x, length, [&](uint32_t at, uint32_t n) {
+            columns[(int32_t)at >> TileEngine::TILE_SHIFT] += n;
+        });
+    }, &header);
+    if(!ok) {
+        std::cerr << "Error opening file: " << job.path << std::endl;
+        return false;
+    }
+
+    Rule rule;
+    if(!pick_rule(job.rule, header, rule)) return false;
+    band = initial_bands(columns, shards)[rank];
+    columns.clear();
+
+    engine.clear();
+    engine.set_rule(rule);
+    ok = parse_rle_file(job.path, job.x0, job.y0, [&](unsigned x, unsigned y, unsigned length) {
+        split_run(x, length, [&](uint32_t at, uint32_t n) {
+            uint32_t offset = ((at >> TileEngine::TILE_SHIFT) - band.lo) & TileEngine::TILE_MASK;
+            if(offset < band.width) engine.add_run(at, y, n);
+        });
+    });
+    engine.commit();
+    return ok;
+}
+
+bool Shard::run(uint64_t generations, uint64_t rebalance_every) {
+    for(uint64_t gen = 0; gen < generations; gen++) {
+        if(!exchange_halos()) return false;
+        engine.step();
+        engine.crop_columns(band.lo, band.width);
+
+        if(rebalance_every && (gen + 1) % rebalance_every == 0 && gen + 1 < generations) {
+            if(!rebalance()) return false;
+        }
+    }
+    return true;
+}
+
+// Down the ring from the last rank to rank 0, each adding its own blocks
+bool Shard::gather(std::vector<CellBlock> &out) {
+    out.clear();
+    if(rank + 1 < shards) {
+        Message in;
+        Reader r{in};
+        if(!link.recv_right(in) || !get_blocks(r, out)) return false;
+    }
+
+    std::vector<CellBlock> own;
+    engine.get_blocks(own);
+    for(const CellBlock &b : own) {
+        uint64_t any = 0;
+        for(uint64_t row : b.rows) any |= row;
+        if(any) out.push_back(b);
+    }
+    if(rank == 0) return true;
+
+    Message message;
+    put_blocks(message, out);
+    return link.send_left(message);
+}
+
+bool Shard::total_population(uint64_t &total) {
+    total = engine.population();
+    if(rank + 1 < shards) {
+        Message in;
+        Reader r{in};
+        uint64_t right;
+        if(!link.recv_right(in) || !r.get(right)) return false;
+        total += right;
+    }
+    if(rank == 0) return true;
+
+    Message message;
+    put(message, total);
+    return link.send_left(message);
+}
+
+// Not sharded after all: the whole pattern in one TileEngine
+bool run_single(const Job &job, ShardResult &result) {
+    TileEngine engine;
+    RleHeader header;
+    Rule rule;
+    if(!load_rle_file(job.path, engine, job.x0, job.y0, &header)) {
+        std::cerr << "Error opening file: " << job.path << std::endl;
+        return false;
+    }
+    if(!pick_rule(job.rule, header, rule)) return false;
+    engine.set_rule(rule);
+
+    engine.advance(job.generations);
+    result.population = engine.population();
+    return job.opts.save.empty() || save_board(job.opts.save, engine);
+}
+
+#ifdef FAST_LIFE_HAVE_SOCKETS
+
+// One framed message being sent or received on a non-blocking socket
+struct Transfer {
+    int fd;
+    const Message *send; // one of these two is set
+    Message *recv;
+    uint64_t length = 0;
+    size_t done = 0; // bytes including the 8 byte length
+};
+
+bool transfer_step(Transfer &t) {
+    const size_t HEADER = sizeof(uint64_t);
+    for(;;) {
+        ssize_t n;
+        if(t.send) {
+            uint64_t length = t.send->size();
+            if(length > MAX_MESSAGE) return false;
+            if(t.done == HEADER + length) return true;
+
+            const uint8_t *p = t.done < HEADER ? (const uint8_t *)&length + t.done
+                                               : t.send->data() + (t.done - HEADER);
+            size_t left = t.done < HEADER ? HEADER - t.done : HEADER + length - t.done;
+#ifdef MSG_NOSIGNAL
+            n = ::send(t.fd, p, left, MSG_NOSIGNAL);
+#else
+            n = ::send(t.fd, p, left, 0);
+#endif
+        } else {
+            if(t.done >= HEADER && t.done == HEADER + t.length) return true;
+
+            uint8_t *p;
+            size_t left;
+            if(t.done < HEADER) {
+                p = (uint8_t *)&t.length + t.done;
+                left = HEADER - t.done;
+            } else {
+                p = t.recv->data() + (t.done - HEADER);
+                left = HEADER + t.length - t.done;
+            }
+            n = ::recv(t.fd, p, left, 0);
+            if(n == 0) return false; // neighbour went away
+        }
+
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        t.done += n;
+        if(!t.send && t.done == HEADER) {
+            if(t.length > MAX_MESSAGE) return false;
+            t.recv->resize(t.length);
+        }
+    }
+}
+
+bool transfer_finished(const Transfer &t) {
+    const size_t HEADER = sizeof(uint64_t);
+    if(t.send) return t.done == HEADER + t.send->size();
+    return t.done >= HEADER && t.done == HEADER + t.length;
+}
+
+// Drives every transfer at once until they're all done
+bool run_transfers(Transfer *transfers, size_t count) {
+    std::vector<pollfd> fds;
+    for(;;) {
+        fds.clear();
+        for(size_t i = 0; i < count; i++) {
+            Transfer &t = transfers[i];
+            if(!transfer_step(t)) return false;
+            if(!transfer_finished(t)) fds.push_back({t.fd, (short)(t.send ? POLLOUT : POLLIN), 0});
+        }
+        if(fds.empty()) return true;
+
+        int n = poll(fds.data(), fds.size(), -1);
+        if(n < 0 && errno != EINTR) return false;
+    }
+}
+
+void set_nonblocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+}
+
+bool split_host(const std::string &host_port, std::string &host, std::string &port) {
+    size_t colon = host_port.rfind(':');
+    if(colon == std::string::npos || colon + 1 == host_port.size()) return false;
+    host = host_port.substr(0, colon);
+    port = host_port.substr(colon + 1);
+    if(host.size() > 1 && host.front() == '[' && host.back() == ']')
+        host = host.substr(1, host.size() - 2);
+    return true;
+}
+
+int tcp_listen(const std::string &port) {
+    addrinfo hints = {}, *res;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if(getaddrinfo(nullptr, port.c_str(), &hints, &res) != 0) return -1;
+
+    int fd = -1;
+    for(addrinfo *a = res; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if(fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if(bind(fd, a->ai_addr, a->ai_addrlen) != 0 || listen(fd, 4) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+int tcp_connect(const std::string &host, const std::string &port) {
+    addrinfo hints = {}, *res;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    // the other side may still be starting up
+    for(int attempt = 0; attempt < 300; attempt++) {
+        if(getaddrinfo(host.c_str(), port.c_str(), &hints, &res) == 0) {
+            for(addrinfo *a = res; a; a = a->ai_next) {
+                int fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+                if(fd < 0) continue;
+                if(connect(fd, a->ai_addr, a->ai_addrlen) == 0) {
+                    freeaddrinfo(res);
+                    return fd;
+                }
+                close(fd);
+            }
+            freeaddrinfo(res);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return -1;
+}
+
+void set_nodelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+#endif // FAST_LIFE_HAVE_SOCKETS
+
+// One rank's whole life: load its band, run, then either gather onto rank
+// 0 or sum the population there and save the band where it is
+bool run_rank(int rank, int shards, Transport &link, const Job &job, ShardResult &result) {
+    Shard shard(rank, shards, link);
+    if(!shard.handshake()) {
+        std::cerr << "shard " << rank << ": neighbours don't match the ring" << std::endl;
+        return false;
+    }
+    if(!shard.load(job) || !shard.run(job.generations, job.opts.rebalance_every)) return false;
+
+    if(!job.opts.gather) {
+        if(!shard.total_population(result.population)) return false;
+        return job.opts.save.empty() || save_board(rank_path(job.opts.save, rank), shard.board());
+    }
+
+    std::vector<CellBlock> gathered;
+    if(!shard.gather(gathered)) return false;
+    if(rank != 0) return true;
+
+    TileEngine all;
+    all.set_rule(shard.board().get_rule());
+    for(const CellBlock &b : gathered) all.add_block(b);
+    all.commit();
+    result.population = all.population();
+    return job.opts.save.empty() || save_board(job.opts.save, all);
+}
+
+} // namespace
+
+#ifdef FAST_LIFE_HAVE_SOCKETS
+
+SocketTransport::SocketTransport(int left_fd, int right_fd)
+    : left_fd(left_fd), right_fd(right_fd) {
+    set_nonblocking(left_fd);
+    set_nonblocking(right_fd);
+}
+
+SocketTransport::~SocketTransport() {
+    close(left_fd);
+    close(right_fd);
+}
+
+bool SocketTransport::exchange(const Message &to_left, const Message &to_right,
+                               Message &from_left, Message &from_right) {
+    Transfer t[4] = {{left_fd, &to_left, nullptr}, {right_fd, &to_right, nullptr},
+                     {left_fd, nullptr, &from_left}, {right_fd, nullptr, &from_right}};
+    return run_transfers(t, 4);
+}
+
+bool SocketTransport::send_left(const Message &message) {
+    Transfer t = {left_fd, &message, nullptr};
+    return run_transfers(&t, 1);
+}
+
+bool SocketTransport::recv_right(Message &message) {
+    Transfer t = {right_fd, nullptr, &message};
+    return run_transfers(&t, 1);
+}
+
+std::unique_ptr<Transport> connect_tcp_ring(int rank, const std::vector<std::string> &hosts) {
+    int shards = (int)hosts.size();
+    std::string host, port, right_host, right_port;
+    if(rank < 0 || rank >= shards || !split_host(hosts[rank], host, port) ||
+       !split_host(hosts[(rank + 1) % shards], right_host, right_port)) {
+        return nullptr;
+    }
+
+    int listener = tcp_listen(port);
+    if(listener < 0) return nullptr;
+
+    int right = tcp_connect(right_host, right_port);
+    int left = right < 0 ? -1 : accept(listener, nullptr, nullptr);
+    close(listener);
+    if(left < 0) {
+        if(right >= 0) close(right);
+        return nullptr;
+    }
+
+    set_nodelay(left);
+    set_nodelay(right);
+    return std::make_unique<SocketTransport>(left, right);
+}
+
+bool run_sharded(const std::string &path, unsigned x0, unsigned y0, const std::string &rule,
+                 uint64_t generations, const ShardOptions &opts, ShardResult &result) {
+    result = ShardResult();
+    Job job{path, x0, y0, rule, generations, opts};
+    int shards = opts.hosts.empty() ? opts.shards : (int)opts.hosts.size();
+    if(shards <= 1) return run_single(job, result);
+
+    bool ok;
+    if(!opts.hosts.empty()) {
+        result.root = opts.rank == 0;
+        std::unique_ptr<Transport> link = connect_tcp_ring(opts.rank, opts.hosts);
+        if(!link) {
+            std::cerr << "shard " << opts.rank << ": couldn't join the ring" << std::endl;
+            return false;
+        }
+        ok = run_rank(opts.rank, shards, *link, job, result);
+    } else {
+        // boundary j joins rank j - 1 (its [0] end) to rank j (its [1] end)
+        std::vector<int> ends(2 * shards, -1);
+        for(int j = 0; j < shards; j++) {
+            if(socketpair(AF_UNIX, SOCK_STREAM, 0, &ends[2 * j]) != 0) {
+                for(int fd : ends) if(fd >= 0) close(fd);
+                return false;
+            }
+        }
+        auto left_end = [&](int r) { return ends[2 * r + 1]; };
+        auto right_end = [&](int r) { return ends[2 * ((r + 1) % shards)]; };
+
+        std::cout.flush();
+        fflush(nullptr);
+
+        std::vector<pid_t> children;
+        for(int r = 1; r < shards; r++) {
+            pid_t pid = fork();
+            if(pid < 0) break;
+            if(pid == 0) {
+                for(int fd : ends) {
+                    if(fd != left_end(r) && fd != right_end(r)) close(fd);
+                }
+                SocketTransport link(left_end(r), right_end(r));
+                bool child_ok = run_rank(r, shards, link, job, result);
+                _exit(child_ok ? 0 : 1);
+            }
+            children.push_back(pid);
+        }
+
+        for(int fd : ends) {
+            if(fd != left_end(0) && fd != right_end(0)) close(fd);
+        }
+        {
+            SocketTransport link(left_end(0), right_end(0));
+            ok = (int)children.size() == shards - 1 &&
+                 run_rank(0, shards, link, job, result);
+        }
+
+        for(pid_t pid : children) {
+            int status;
+            while(waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+            ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        }
+    }
+    return ok;
+}
+
+#else
+
+SocketTransport::SocketTransport(int left_fd, int right_fd)
+    : left_fd(left_fd), right_fd(right_fd) {}
+SocketTransport::~SocketTransport() {}
+bool SocketTransport::exchange(const Message &, const Message &, Message &, Message &) { return false; }
+bool SocketTransport::send_left(const Message &) { return false; }
+bool SocketTransport::recv_right(Message &) { return false; }
+
+std::unique_ptr<Transport> connect_tcp_ring(int, const std::vector<std::string> &) {
+    return nullptr;
+}
+
+bool run_sharded(const std::string &path, unsigned x0, unsigned y0, const std::string &rule,
+                 uint64_t generations, const ShardOptions &opts, ShardResult &result) {
+    result = ShardResult();
+    int shards = opts.hosts.empty() ? opts.shards : (int)opts.hosts.size();
+    if(shards > 1) {
+        std::cerr << "sharded runs need POSIX sockets" << std::endl;
+        return false;
+    }
+    Job job{path, x0, y0, rule, generations, opts};
+    return run_single(job, result);
+}
+
+#endif // FAST_LIFE_HAVE_SOCKETS
@@ -0,0 +1,102 @@
+#ifndef SHARD_HPP
+#define SHARD_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "engine.hpp"
+
+// Multi-process runs for boards that don't fit one process. The plane is
+// cut into vertical bands of whole 64 cell tile columns, one band per
+// process, and the bands form a ring the same way x wraps at 2^32, so a
+// sharded run ends on exactly the board a single engine would.
+//
+// Every rank reads the pattern itself, once to count live cells per tile
+// column so they all cut the same bands, and again keeping only the runs
+// inside its own band. No process ever holds the whole board unless the
+// run asks for a gather at the end.
+//
+// Each shard steps its band with a TileEngine. Before every generation it
+// swaps its outermost live column with each neighbour and ORs theirs in
+// just outside its own edges, steps, then drops everything outside the
+// band again. Every so often neighbours compare tile counts and the
+// heavier one hands over whole tile columns, so a gun filling one side
+// of the plane pulls the boundaries along behind its output.
+
+typedef std::vector<uint8_t> Message;
+
+// Length-framed messages to the two ring neighbours, in native byte order
+// (the handshake refuses a neighbour with the other one). Anything that can
+// do these can carry a sharded run.
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    // Sends both and receives both at once, so two neighbours sending to
+    // each other never wait on each other's full buffers.
+    virtual bool exchange(const Message &to_left, const Message &to_right,
+                          Message &from_left, Message &from_right) = 0;
+
+    // one way only, for gathering the board onto rank 0
+    virtual bool send_left(const Message &message) = 0;
+    virtual bool recv_right(Message &message) = 0;
+};
+
+// Over a pair of connected stream sockets, non-blocking with poll()
+class SocketTransport : public Transport {
+public:
+    SocketTransport(int left_fd, int right_fd);
+    ~SocketTransport() override;
+
+    SocketTransport(const SocketTransport &) = delete;
+    SocketTransport &operator=(const SocketTransport &) = delete;
+
+    bool exchange(const Message &to_left, const Message &to_right,
+                  Message &from_left, Message &from_right) override;
+    bool send_left(const Message &message) override;
+    bool recv_right(Message &message) override;
+
+private:
+    int left_fd, right_fd;
+};
+
+// Rank `rank` of a ring over TCP, hosts[i] is "host:port" for rank i.
+// Listens on its own port for its left neighbour and connects to its right
+// one, retrying for a while until it comes up. nullptr on failure.
+std::unique_ptr<Transport> connect_tcp_ring(int rank, const std::vector<std::string> &hosts);
+
+struct ShardOptions {
+    int shards = 1;
+    // rebalance every this many generations, 0 never
+    uint64_t rebalance_every = 16;
+
+    // Empty: fork `shards` processes on this machine joined by
+    // socketpairs. Otherwise this process is rank `rank` of a TCP ring
+    // over hosts, each rank started separately with the same pattern.
+    std::vector<std::string> hosts;
+    int rank = 0;
+
+    // Collect every band onto rank 0 at the end, which then needs room for
+    // the whole board. Otherwise only the population is summed there.
+    bool gather = false;
+    // With gather rank 0 writes the whole board here, without it every
+    // rank writes its own band with ".<rank>" before the extension
+    std::string save;
+};
+
+struct ShardResult {
+    bool root = true; // rank 0, the one with something to report
+    uint64_t population = 0; // of the whole board, on rank 0
+};
+
+// Steps the RLE pattern at path, placed at (x0, y0) unless the file has
+// its own #CXRLE Pos, `generations` generations across the shards. rule
+// beats the file's own when it isn't empty. Forked shards never return.
+// False on a bad pattern or rule, a failed save, or a transport or fork
+// failure.
+bool run_sharded(const std::string &path, unsigned x0, unsigned y0, const std::string &rule,
+                 uint64_t generations, const ShardOptions &opts, ShardResult &result);
+
+#endif // SHARD_HPP
@@ -0,0 +1,187 @@
+#include <algorithm>
+
+#include "sparse_engine.hpp"
+#include "cell_hash.hpp"
+#include "metrics.hpp"
+
+// below this many keys std::sort beats clearing the radix histograms
+static const size_t RADIX_MIN = 1 << 10;
+static const unsigned DIGIT_BITS = 16;
+// source cells per slab, about 2.3 MB of keys in each scratch buffer
+static const size_t SLAB_CELLS = 1 << 15;
+
+SparseEngine::SparseEngine() : counts((size_t)1 << DIGIT_BITS) {}
+
+void SparseEngine::set_board(const Board &board) {
+    cells.clear();
+    for(const Cell &c : board) cells.push_back(key(c.first, c.second));
+    std::sort(cells.begin(), cells.end());
+    find_columns();
+    hash_valid = false;
+}
+
+Board SparseEngine::get_board() const {
+    Board board;
+    for(uint64_t k : cells) board.insert({key_x(k), key_y(k)});
+    return board;
+}
+
+void SparseEngine::get_cells(std::vector<Cell> &out) const {
+    out.resize(cells.size());
+    for(size_t i = 0; i < cells.size(); i++)
+        out[i] = {key_x(cells[i]), key_y(cells[i])};
+}
+
+void SparseEngine::find_columns() {
+    min_x = INT32_MAX;
+    max_x = INT32_MIN;
+    for(uint64_t k : cells) {
+        min_x = std::min(min_x, (int32_t)key_x(k));
+        max_x = std::max(max_x, (int32_t)key_x(k));
+    }
+}
+
+bool SparseEngine::bounding_box(int32_t &min_x_out, int32_t &min_y_out,
+                                int32_t &max_x_out, int32_t &max_y_out) const {
+    if(cells.empty()) return false;
+
+    // keys sort by signed row
+    min_y_out = (int32_t)key_y(cells.front());
+    max_y_out = (int32_t)key_y(cells.back());
+    min_x_out = min_x;
+    max_x_out = max_x;
+    return true;
+}
+
+void SparseEngine::add_run(unsigned x, unsigned y, unsigned length) {
+    for(unsigned i = 0; i < length; i++) cells.push_back(key(x + i, y));
+    hash_valid = false;
+}
+
+void SparseEngine::commit() {
+    std::sort(cells.begin(), cells.end());
+    cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+    find_columns();
+}
+
+uint64_t SparseEngine::hash() const {
+    if(!hash_valid) {
+        hash_value = 0;
+        for(uint64_t k : cells) hash_value += cell_hash((int32_t)key_x(k), (int32_t)key_y(k));
+        hash_valid = true;
+    }
+    return hash_value;
+}
+
+// LSD radix sort on 16 bit digits, ping-ponging with scratch. Digits that
+// are the same in every key are skipped, so a pattern that doesn't
+// straddle a multiple of 65536 in x or y only pays for two passes.
+void SparseEngine::radix_sort(std::vector<uint64_t> &keys) {
+    size_t n = keys.size();
+    if(n < RADIX_MIN) {
+        std::sort(keys.begin(), keys.end());
+        return;
+    }
+
+    uint64_t differ = 0;
+    for(uint64_t k : keys) differ |= k ^ keys[0];
+
+    scratch.resize(n);
+    for(unsigned shift = 0; shift < 64; shift += DIGIT_BITS) {
+        const uint64_t mask = ((uint64_t)1 << DIGIT_BITS) - 1;
+        if(!((differ >> shift) & mask)) continue;
+
+        std::fill(counts.begin(), counts.end(), 0);
+        for(uint64_t k : keys) counts[(k >> shift) & mask]++;
+
+        uint32_t sum = 0;
+        for(uint32_t &c : counts) {
+            uint32_t here = c;
+            c = sum;
+            sum += here;
+        }
+        for(uint64_t k : keys) scratch[counts[(k >> shift) & mask]++] = k;
+        keys.swap(scratch);
+    }
+}
+
+void SparseEngine::step() {
+    METRICS_GENERATION(*this, 1);
+
+    next.clear();
+    int32_t lo = INT32_MAX, hi = INT32_MIN;
+    const uint64_t *live = cells.data(), *live_end = live + cells.size();
+
+    // Rows at the very top and bottom of the key order neighbour each
+    // other, which the slabs below can't see, so that board goes in one go
+    size_t n = cells.size();
+    bool seam = n && ((cells.front() >> 32) == 0 || (cells.back() >> 32) == UINT32_MAX);
+
+    // A slab of whole rows at a time, so the scratch buffers stay a fixed
+    // size instead of 9 keys a cell. Keys for rows the next slab can still
+    // add to are carried over to the front of contributions.
+    contributions.clear();
+    for(size_t i = 0; i < n;) {
+        size_t j = seam ? n : std::min(n, i + SLAB_CELLS);
+        while(j < n && (cells[j] >> 32) == (cells[j - 1] >> 32)) j++;
+
+        METRICS_BEGIN(PHASE_CANDIDATES);
+        size_t carried = contributions.size();
+        contributions.resize(carried + (j - i) * 9);
+        uint64_t *out = contributions.data() + carried;
+        for(size_t c = i; c < j; c++) {
+            uint32_t x = (uint32_t)cells[c], y = (uint32_t)(cells[c] >> 32);
+            for(uint32_t dy = -1; dy != 2; dy++) {
+                uint64_t row = (uint64_t)(y + dy) << 32;
+                *out++ = row | (uint32_t)(x - 1);
+                *out++ = row | x;
+                *out++ = row | (uint32_t)(x + 1);
+            }
+        }
+        radix_sort(contributions);
+        METRICS_END(PHASE_CANDIDATES);
+        METRICS_COUNT(COUNTER_CANDIDATES, (j - i) * 9);
+
+        // the next slab starts at least a row down and reaches one row up
+        const uint64_t *c = contributions.data(), *end = c + contributions.size();
+        const uint64_t *done = end;
+        if(j < n) {
+            uint64_t limit = ((cells[j] >> 32) - 1) << 32;
+            done = std::lower_bound(c, end, limit);
+        }
+
+        // Both lists are sorted, so whether a key is alive now is found by
+        // walking cells alongside the runs.
+        METRICS_BEGIN(PHASE_COMPUTE);
+        while(c != done) {
+            uint64_t k = *c;
+            const uint64_t *run = c + 1;
+            while(run != done && *run == k) run++;
+            int count = (int)(run - c);
+            c = run;
+
+            while(live != live_end && *live < k) live++;
+            bool alive = live != live_end && *live == k;
+
+            bool lives = rule.next(alive, count - alive);
+            if(lives) {
+                next.push_back(k);
+                lo = std::min(lo, (int32_t)key_x(k));
+                hi = std::max(hi, (int32_t)key_x(k));
+            }
+            if(hash_valid && lives != alive) {
+                uint64_t h = cell_hash((int32_t)key_x(k), (int32_t)key_y(k));
+                hash_value += lives ? h : -h;
+            }
+        }
+        METRICS_END(PHASE_COMPUTE);
+
+        size_t rest = end - done;
+        std::copy(done, end, contributions.data());
+        contributions.resize(rest);
+        i = j;
+    }
+    cells.swap(next);
+    min_x = lo;
+    max_x = hi;
+}
@@ -0,0 +1,68 @@
+#ifndef SPARSE_ENGINE_HPP
+#define SPARSE_ENGINE_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "engine.hpp"
+
+// Sparse engine for thin patterns (guns, glider streams, long fuses) where
+// the tile engine would mostly be stepping empty rows. Live cells are one
+// sorted array of packed (y << 32) | x keys, 8 bytes a cell with no node
+// overhead, and the step writes the next generation into a second one.
+//
+// A step goes down the board a slab of rows at a time. It writes the 9
+// keys of every cell's 3x3 block into a scratch buffer, radix sorts it and
+// walks the runs: a run's length is the cell's neighbour count plus itself
+// when alive. The output comes out sorted, so it's the next board as it
+// stands. Slabs keep the scratch to a few MB however big the board is, and
+// every buffer is kept between steps, so once they've grown a step doesn't
+// allocate.
+class SparseEngine : public Engine {
+public:
+    SparseEngine();
+
+    const char *name() const override { return "sparse"; }
+
+    void set_board(const Board &board) override;
+    Board get_board() const override;
+    void get_cells(std::vector<Cell> &cells) const override;
+    bool bounding_box(int32_t &min_x, int32_t &min_y,
+                      int32_t &max_x, int32_t &max_y) const override;
+
+    void clear() override { cells.clear(); hash_valid = false; }
+    void add_run(unsigned x, unsigned y, unsigned length) override;
+    // sorts and dedupes whatever add_run appended
+    void commit() override;
+
+    void step() override;
+    size_t population() const override { return cells.size(); }
+    uint64_t hash() const override;
+
+    // Rows go in offset by 2^31 so keys sort by signed y. The only place
+    // rows wrap round is then out at +-2^31, well away from most patterns.
+    static uint64_t key(uint32_t x, uint32_t y) {
+        return ((uint64_t)(y ^ 0x80000000u) << 32) | x;
+    }
+    static uint32_t key_x(uint64_t k) { return (uint32_t)k; }
+    static uint32_t key_y(uint64_t k) { return (uint32_t)(k >> 32) ^ 0x80000000u; }
+
+private:
+    void radix_sort(std::vector<uint64_t> &keys);
+
+    // x range of cells read signed, y comes from the ends of cells
+    void find_columns();
+
+    std::vector<uint64_t> cells; // sorted, unique
+    int32_t min_x = INT32_MAX, max_x = INT32_MIN;
+    std::vector<uint64_t> next;
+    std::vector<uint64_t> contributions;
+    std::vector<uint64_t> scratch;
+    std::vector<uint32_t> counts;
+
+    // only maintained by step() once hash() has been called
+    mutable uint64_t hash_value = 0;
+    mutable bool hash_valid = false;
+};
+
+#endif // SPARSE_ENGINE_HPP
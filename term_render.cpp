@@ -0,0 +1,349 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <thread>
+
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "term_render.hpp"
+#include "engine.hpp"
+#include "history.hpp"
+
+// Braille dots by (x, y) inside the 2x4 block, see U+2800
+static const uint8_t BRAILLE_BITS[2][4] = {
+    {0x01, 0x02, 0x04, 0x40},
+    {0x08, 0x10, 0x20, 0x80},
+};
+
+// ' ', upper half, lower half, full block
+static const char *HALF_BLOCKS[4] = {" ", "▀", "▄", "█"};
+
+TermRenderer::TermRenderer(bool half_blocks) : half_blocks(half_blocks) {
+    update_size();
+    fputs("\033[?25l", stdout);
+}
+
+TermRenderer::~TermRenderer() {
+    printf("\033[%d;1H\033[?25h\n", rows + 1);
+    fflush(stdout);
+}
+
+void TermRenderer::update_size() {
+    struct winsize ws;
+    int new_cols = 80, new_rows = 24;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 && ws.ws_row > 0) {
+        new_cols = ws.ws_col;
+        new_rows = ws.ws_row;
+    }
+    new_rows = std::max(1, new_rows - 1); // bottom line is the status
+
+    if (new_cols != cols || new_rows != rows) {
+        cols = new_cols;
+        rows = new_rows;
+        full_redraw = true;
+    }
+}
+
+void TermRenderer::center_on(const std::vector<Cell> &cells) {
+    if (cells.empty()) return;
+
+    int32_t min_x = INT32_MAX, max_x = INT32_MIN, min_y = INT32_MAX, max_y = INT32_MIN;
+    for (const Cell &cell : cells) {
+        min_x = std::min(min_x, (int32_t)cell.first);
+        max_x = std::max(max_x, (int32_t)cell.first);
+        min_y = std::min(min_y, (int32_t)cell.second);
+        max_y = std::max(max_y, (int32_t)cell.second);
+    }
+
+    view_x = ((int64_t)min_x + max_x) / 2 - (int64_t)cols * cell_w() / 2;
+    view_y = ((int64_t)min_y + max_y) / 2 - (int64_t)rows * cell_h() / 2;
+}
+
+// Moves the view an eighth of the screen at a time
+void TermRenderer::pan(int dx, int dy) {
+    view_x += (int64_t)dx * std::max(1, cols / 8) * cell_w();
+    view_y += (int64_t)dy * std::max(1, rows / 8) * cell_h();
+}
+
+void TermRenderer::view_box(int32_t &min_x, int32_t &min_y, int32_t &max_x, int32_t &max_y) {
+    update_size();
+    auto clamp_cell = [](int64_t v) { return (int32_t)std::clamp<int64_t>(v, INT32_MIN, INT32_MAX); };
+    min_x = clamp_cell(view_x);
+    min_y = clamp_cell(view_y);
+    max_x = clamp_cell(view_x + (int64_t)cols * cell_w() - 1);
+    max_y = clamp_cell(view_y + (int64_t)rows * cell_h() - 1);
+}
+
+void TermRenderer::put_glyph(std::string &out, uint8_t mask) const {
+    if (half_blocks) {
+        out += HALF_BLOCKS[mask & 3];
+    } else if (mask == 0) {
+        out += ' ';
+    } else {
+        // U+2800 + mask as utf-8
+        out += (char)0xE2;
+        out += (char)(0xA0 | (mask >> 6));
+        out += (char)(0x80 | (mask & 0x3F));
+    }
+}
+
+void TermRenderer::draw(const std::vector<Cell> &cells, const std::string &status) {
+    update_size();
+
+    int cw = cell_w(), ch = cell_h();
+    frame.assign((size_t)cols * rows, 0);
+    for (const Cell &cell : cells) {
+        int64_t x = (int32_t)cell.first - view_x;
+        int64_t y = (int32_t)cell.second - view_y;
+        if (x < 0 || y < 0 || x >= (int64_t)cols * cw || y >= (int64_t)rows * ch) continue;
+
+        uint8_t bit = half_blocks ? (y & 1 ? 2 : 1) : BRAILLE_BITS[x & 1][y & 3];
+        frame[(size_t)(y / ch) * cols + (size_t)(x / cw)] |= bit;
+    }
+
+    out.clear();
+    if (full_redraw || last_frame.size() != frame.size()) {
+        out += "\033[H\033[2J";
+        last_frame.assign(frame.size(), 0);
+        full_redraw = false;
+    }
+
+    // Only touch characters that changed, and only move the cursor when
+    // the next change isn't right where the last write left it
+    char move[32];
+    int cursor_r = -1, cursor_c = -1;
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            size_t i = (size_t)r * cols + c;
+            if (frame[i] == last_frame[i]) continue;
+
+            if (r != cursor_r || c != cursor_c) {
+                snprintf(move, sizeof(move), "\033[%d;%dH", r + 1, c + 1);
+                out += move;
+            }
+            put_glyph(out, frame[i]);
+            cursor_r = r;
+            cursor_c = c + 1 < cols ? c + 1 : -1; // don't trust the cursor after the last column
+        }
+    }
+
+    snprintf(move, sizeof(move), "\033[%d;1H", rows + 1);
+    out += move;
+    out.append(status, 0, std::min(status.size(), (size_t)cols - 1));
+    out += "\033[K";
+
+    fwrite(out.data(), 1, out.size(), stdout);
+    fflush(stdout);
+    std::swap(frame, last_frame);
+}
+
+namespace {
+
+enum Key { KEY_NONE, KEY_LEFT, KEY_RIGHT, KEY_UP, KEY_DOWN, KEY_OTHER };
+
+volatile std::sig_atomic_t interrupted = 0;
+
+void on_interrupt(int) { interrupted = 1; }
+
+// Puts stdin in non-blocking, no-echo mode for as long as it's alive,
+// if stdin is a terminal at all
+class RawKeys {
+public:
+    RawKeys() {
+        if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &saved) != 0) return;
+
+        struct termios raw = saved;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        active = tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0;
+    }
+
+    ~RawKeys() {
+        if (active) tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    }
+
+    // Next key press, arrows come in as ESC [ A..D
+    Key next(char &ch) {
+        if (!active) return KEY_NONE;
+
+        if (pending.empty()) {
+            char buf[64];
+            ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+            if (n <= 0) return KEY_NONE;
+            pending.assign(buf, n);
+        }
+
+        if (pending.size() >= 3 && pending[0] == '\033' && pending[1] == '[') {
+            char code = pending[2];
+            pending.erase(0, 3);
+            switch (code) {
+                case 'A': return KEY_UP;
+                case 'B': return KEY_DOWN;
+                case 'C': return KEY_RIGHT;
+                case 'D': return KEY_LEFT;
+            }
+            return next(ch);
+        }
+
+        ch = pending[0];
+        pending.erase(0, 1);
+        return KEY_OTHER;
+    }
+
+private:
+    struct termios saved;
+    bool active = false;
+    std::string pending;
+};
+
+}
+
+void print_to_term(Engine &engine, const int iterations, const TermOptions &opts) {
+    typedef std::chrono::steady_clock clock;
+    const uint64_t JUMP_GENERATIONS = 100;
+
+    TermRenderer term(opts.half_blocks);
+    RawKeys keys;
+
+    interrupted = 0;
+    void (*old_handler)(int) = std::signal(SIGINT, on_interrupt);
+
+    // Cycles are watched from the producer thread, the status line only
+    // reads what it found once found is set
+    CycleDetector cycles;
+    Cycle cycle;
+    std::atomic<bool> found{false};
+    History::StepHook hook;
+    if (opts.cycles != CYCLES_OFF) {
+        cycles.observe(engine, 0);
+        hook = [&](Engine &e, uint64_t &generation) {
+            if (!cycles.observe(e, generation)) return false;
+            cycle = cycles.cycle();
+            found = true;
+            if (opts.cycles == CYCLES_SKIP) {
+                generation = fast_forward(e, cycle, generation, std::max(iterations, 0));
+            }
+            return true;
+        };
+    }
+
+    HistoryOptions history_opts;
+    history_opts.last_generation = std::max(iterations, 0);
+    History history(engine, 0, history_opts, hook);
+    HistoryCursor cursor(history);
+    history.start();
+
+    std::vector<Cell> cells;
+    cursor.seek(0);
+    cursor.get_cells(cells);
+    term.center_on(cells);
+
+    auto frame_period = std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(1.0 / std::max(1, opts.fps)));
+    auto next_frame = clock::now();
+    auto last = clock::now();
+
+    double gps = opts.gps;
+    double playhead = 0;
+    bool paused = false;
+    int direction = 1;
+
+    auto jump = [&](double generations) {
+        paused = true;
+        playhead = std::clamp(std::floor(playhead) + generations,
+                              (double)history.oldest(), (double)history.newest());
+    };
+
+    while (!interrupted) {
+        char ch = 0;
+        bool quit = false;
+        for (Key key = keys.next(ch); key != KEY_NONE; key = keys.next(ch)) {
+            if (key == KEY_LEFT) term.pan(-1, 0);
+            else if (key == KEY_RIGHT) term.pan(1, 0);
+            else if (key == KEY_UP) term.pan(0, -1);
+            else if (key == KEY_DOWN) term.pan(0, 1);
+            else if (ch == 'h') term.pan(-1, 0);
+            else if (ch == 'l') term.pan(1, 0);
+            else if (ch == 'k') term.pan(0, -1);
+            else if (ch == 'j') term.pan(0, 1);
+            else if (ch == ' ') paused = !paused;
+            else if (ch == '.') jump(1);
+            else if (ch == ',') jump(-1);
+            else if (ch == '>') jump(JUMP_GENERATIONS);
+            else if (ch == '<') jump(-(double)JUMP_GENERATIONS);
+            else if (ch == 'g') jump(-playhead);
+            else if (ch == 'G') jump((double)history.newest() - playhead);
+            else if (ch == 'r') direction = -direction;
+            else if (ch == ']') gps = gps >= 4096 ? 0 : gps * 2;
+            else if (ch == '[') gps = gps <= 0 ? 4096 : std::max(1.0, gps / 2);
+            else if (ch == 'q') quit = true;
+        }
+        if (quit) break;
+
+        auto now = clock::now();
+        double dt = std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        uint64_t oldest = history.oldest(), newest = history.newest();
+        if (!paused) {
+            if (gps <= 0) playhead = direction > 0 ? newest : oldest;
+            else playhead += direction * gps * dt;
+        }
+        playhead = std::clamp(playhead, (double)oldest, (double)newest);
+        history.set_playhead((uint64_t)playhead);
+
+        // playing forward into the end of a finished run
+        bool finished = history.finished() && !paused && direction > 0 &&
+                        (uint64_t)playhead == history.newest();
+        if (now >= next_frame || finished) {
+            int32_t min_x, min_y, max_x, max_y;
+            term.view_box(min_x, min_y, max_x, max_y);
+            uint64_t generation = cursor.seek((uint64_t)playhead, min_x, min_y, max_x, max_y);
+            cursor.get_cells(cells);
+
+            std::string speed = paused ? "paused" : gps > 0 ? std::to_string((int)gps) + " gen/s"
+                                                            : "unlimited";
+            char status[256];
+            int len = snprintf(status, sizeof(status), "gen %llu  pop %zu  %s%s  [%llu..%llu]",
+                               (unsigned long long)generation, cursor.population(), speed.c_str(),
+                               direction < 0 && !paused ? " reverse" : "",
+                               (unsigned long long)oldest, (unsigned long long)newest);
+            if (found) {
+                snprintf(status + len, sizeof(status) - len, "  period %llu (%lld, %lld) since gen %llu",
+                         (unsigned long long)cycle.period, (long long)cycle.dx, (long long)cycle.dy,
+                         (unsigned long long)cycle.start);
+            }
+            term.draw(cells, status);
+
+            next_frame += frame_period;
+            if (next_frame < now) next_frame = now + frame_period;
+        }
+        if (finished) break;
+
+        // nothing to do until the next frame, but keep an ear on the keyboard
+        std::this_thread::sleep_until(std::min(next_frame, now + std::chrono::milliseconds(10)));
+    }
+
+    history.stop();
+    std::signal(SIGINT, old_handler);
+
+    // The producer ran ahead of the screen, put the engine back on the
+    // generation that was showing so whatever comes next (--save) sees that
+    cursor.seek(cursor.generation());
+    cursor.get_cells(cells);
+    engine.clear();
+    for (size_t i = 0; i < cells.size();) {
+        size_t j = i + 1;
+        while (j < cells.size() && cells[j].second == cells[i].second &&
+               cells[j].first == cells[j - 1].first + 1) j++;
+        engine.add_run(cells[i].first, cells[i].second, j - i);
+        i = j;
+    }
+    engine.commit();
+}
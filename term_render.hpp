@@ -0,0 +1,64 @@
+#ifndef TERM_RENDER_HPP
+#define TERM_RENDER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cycle.hpp"
+#include "game.hpp"
+
+class Engine;
+
+struct TermOptions {
+    int fps = 30;             // frames drawn per second
+    double gps = 30;          // generations per second, 0 is as fast as it goes
+    bool half_blocks = false; // 1x2 cells per character instead of 2x4 braille
+    CycleAction cycles = CYCLES_OFF;
+};
+
+// Draws boards into a terminal, several cells to a character. The last frame
+// is kept around and only characters that changed are sent, so a mostly
+// still board costs a handful of bytes per frame even over ssh.
+class TermRenderer {
+public:
+    explicit TermRenderer(bool half_blocks);
+    ~TermRenderer();
+
+    TermRenderer(const TermRenderer &) = delete;
+    TermRenderer &operator=(const TermRenderer &) = delete;
+
+    // Cells covered by one character
+    int cell_w() const { return half_blocks ? 1 : 2; }
+    int cell_h() const { return half_blocks ? 2 : 4; }
+
+    void center_on(const std::vector<Cell> &cells);
+    void pan(int dx, int dy);
+    // The board cells the next draw() covers, inclusive and signed
+    void view_box(int32_t &min_x, int32_t &min_y, int32_t &max_x, int32_t &max_y);
+    void draw(const std::vector<Cell> &cells, const std::string &status);
+
+private:
+    void update_size();
+    void put_glyph(std::string &out, uint8_t mask) const;
+
+    bool half_blocks;
+    int cols = 0, rows = 0; // board area in characters, status line excluded
+    int64_t view_x = 0, view_y = 0; // board cell at the top left character
+
+    std::vector<uint8_t> frame, last_frame;
+    bool full_redraw = true;
+    std::string out;
+};
+
+// Runs the engine for the given number of generations, drawing to the
+// terminal at opts.fps. The engine steps ahead on a History producer
+// thread, so playback can pause, run backward ('r'), step either way
+// ('.' and ','), jump 100 generations ('<' and '>') or to either end of
+// what's recorded ('g' and 'G'). Arrows/hjkl pan, '[' and ']' change speed
+// and q quits early. With opts.cycles set, a board that starts repeating
+// ends the run or jumps to the last generation. On return the engine holds
+// the generation last on screen, not wherever the producer had got to.
+void print_to_term(Engine &engine, const int iterations, const TermOptions &opts);
+
+#endif // TERM_RENDER_HPP
@@ -0,0 +1,98 @@
+#include "thread_pool.hpp"
+#include "metrics.hpp"
+
+ThreadPool::ThreadPool(int num_threads) {
+    if(num_threads < 1) num_threads = 1;
+
+    for(int i = 0; i < num_threads; i++) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for(int i = 1; i < num_threads; i++) {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for(std::thread &t : workers) t.join();
+}
+
+bool ThreadPool::pop_task(int id, size_t &task) {
+    {
+        Queue &own = *queues[id];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if(!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for(int i = 1; i < size(); i++) {
+        Queue &victim = *queues[(id + i) % size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if(!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run_tasks(int id) {
+    size_t task;
+    while(pop_task(id, task)) {
+        {
+            METRICS_BUSY(id);
+            (*job.load())(task, id);
+        }
+
+        if(remaining.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> guard(lock);
+            done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::worker_loop(int id) {
+    uint64_t seen = 0;
+    while(true) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&] { return stopping || job_id != seen; });
+            if(stopping) return;
+            seen = job_id;
+        }
+        run_tasks(id);
+    }
+}
+
+void ThreadPool::parallel_for(size_t num_tasks, const Task &fn) {
+    if(num_tasks == 0) return;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        job = &fn;
+        remaining = num_tasks;
+
+        // deal tasks round robin so every worker starts with local work
+        for(size_t t = 0; t < num_tasks; t++) {
+            Queue &q = *queues[t % size()];
+            std::lock_guard<std::mutex> q_guard(q.lock);
+            q.tasks.push_back(t);
+        }
+        job_id++;
+    }
+    wake.notify_all();
+
+    run_tasks(0);
+
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [&] { return remaining == 0; });
+}
@@ -0,0 +1,56 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Long-lived workers so a generation doesn't pay for spawning and joining
+// threads. Each worker has its own deque: it pops from the back of its own
+// and steals from the front of everyone else's once it runs dry, so
+// uneven tasks even out without a central queue.
+class ThreadPool {
+public:
+    typedef std::function<void(size_t task, int worker)> Task;
+
+    explicit ThreadPool(int num_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int size() const { return (int)queues.size(); }
+
+    // Runs fn(task, worker) for every task in [0, num_tasks) and blocks
+    // until they're all done. The calling thread works as worker 0.
+    void parallel_for(size_t num_tasks, const Task &fn);
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+
+    void worker_loop(int id);
+    bool pop_task(int id, size_t &task);
+    void run_tasks(int id);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    std::atomic<const Task *> job{nullptr};
+    std::atomic<size_t> remaining{0};
+    uint64_t job_id = 0;
+    bool stopping = false;
+};
+
+#endif // THREAD_POOL_HPP
@@ -0,0 +1,567 @@
+#include <algorithm>
+#include <cstring>
+
+#include "tile_engine.hpp"
+#include "cell_hash.hpp"
+#include "metrics.hpp"
+
+#if defined(__GNUC__)
+#define FL_ALWAYS_INLINE inline __attribute__((always_inline))
+#if !defined(__clang__)
+// the helpers that pass vectors around are all forced inline, so the note
+// about the AVX calling convention never applies
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+#else
+#define FL_ALWAYS_INLINE inline
+#endif
+
+// absent tiles have been empty for at least three generations
+static const TileEngine::Tile empty_tile = {{}, {}, 0, 0, true, true};
+
+template <typename V>
+static FL_ALWAYS_INLINE void load_rows(V &v, const uint64_t *p) {
+    memcpy(&v, p, sizeof(V));
+}
+
+// count == n as a bit mask, from the four bits of the neighbour count
+template <typename V>
+static FL_ALWAYS_INLINE V count_is(unsigned n, V b0, V b1, V b2, V b3) {
+    return (n & 1 ? b0 : ~b0) & (n & 2 ? b1 : ~b1) &
+           (n & 4 ? b2 : ~b2) & (n & 8 ? b3 : ~b3);
+}
+
+template <typename V>
+static FL_ALWAYS_INLINE V apply_rule(uint16_t birth, uint16_t survive,
+        V b0, V b1, V b2, V b3, V alive) {
+    V next = {};
+    for(unsigned n = 0; n <= 8; n++) {
+        bool born = (birth >> n) & 1, stays = (survive >> n) & 1;
+        if(!born && !stays) continue;
+
+        V eq = count_is(n, b0, b1, b2, b3);
+        if(born && stays) next |= eq;
+        else if(born) next |= eq & ~alive;
+        else next |= eq & alive;
+    }
+    return next;
+}
+
+// Rule policies for step_rows. Conway gets the hand-reduced expression,
+// the other common rules fold apply_rule at compile time and anything else
+// reads the masks at run time. The rule never branches per cell either way.
+struct ConwayKernel {
+    template <typename V>
+    static FL_ALWAYS_INLINE V next(V b0, V b1, V b2, V b3, V alive, const Rule &) {
+        // exactly 3, or exactly 2 and alive
+        return ~b3 & ~b2 & b1 & (b0 | alive);
+    }
+};
+
+template <uint16_t BIRTH, uint16_t SURVIVE>
+struct FixedKernel {
+    template <typename V>
+    static FL_ALWAYS_INLINE V next(V b0, V b1, V b2, V b3, V alive, const Rule &) {
+        return apply_rule(BIRTH, SURVIVE, b0, b1, b2, b3, alive);
+    }
+};
+
+struct GenericKernel {
+    template <typename V>
+    static FL_ALWAYS_INLINE V next(V b0, V b1, V b2, V b3, V alive,
+                                   const Rule &rule) {
+        return apply_rule(rule.birth, rule.survive, b0, b1, b2, b3, alive);
+    }
+};
+
+// Bit-parallel neighbour count for every row of a tile. V is either a
+// plain uint64_t or a GCC/clang vector of them, so one instantiation
+// handles 1, 2 or 4 rows per iteration.
+//
+// c is the tile's 64 rows padded with the row above (c[0]) and the row
+// below (c[65]). wi/ei hold the bits shifted in from the left and right
+// neighbour tiles for the same 66 rows.
+template <typename V, typename K>
+static FL_ALWAYS_INLINE void step_rows(const uint64_t *c, const uint64_t *wi,
+        const uint64_t *ei, uint64_t *out, const Rule &rule) {
+
+    constexpr unsigned lanes = sizeof(V) / sizeof(uint64_t);
+
+    for(unsigned r = 1; r <= TileEngine::TILE_SIZE; r += lanes) {
+        V up, mid, down, w_up, w_mid, w_down, e_up, e_mid, e_down;
+        load_rows(up, c + r - 1);
+        load_rows(mid, c + r);
+        load_rows(down, c + r + 1);
+        load_rows(w_up, wi + r - 1);
+        load_rows(w_mid, wi + r);
+        load_rows(w_down, wi + r + 1);
+        load_rows(e_up, ei + r - 1);
+        load_rows(e_mid, ei + r);
+        load_rows(e_down, ei + r + 1);
+
+        // west neighbour of bit i is bit i-1, east is bit i+1
+        V nw = (up << 1) | w_up;
+        V ne = (up >> 1) | e_up;
+        V w = (mid << 1) | w_mid;
+        V e = (mid >> 1) | e_mid;
+        V sw = (down << 1) | w_down;
+        V se = (down >> 1) | e_down;
+
+        // full adders per row of three, half adder for the middle pair
+        V s_up = nw ^ up ^ ne;
+        V c_up = (nw & up) | (ne & (nw ^ up));
+        V s_down = sw ^ down ^ se;
+        V c_down = (sw & down) | (se & (sw ^ down));
+        V s_mid = w ^ e;
+        V c_mid = w & e;
+
+        // add the three 2-bit partial sums into b3 b2 b1 b0
+        V b0 = s_up ^ s_down ^ s_mid;
+        V k0 = (s_up & s_down) | (s_mid & (s_up ^ s_down));
+        V t = c_up ^ c_down ^ c_mid;
+        V k1 = (c_up & c_down) | (c_mid & (c_up ^ c_down));
+        V b1 = t ^ k0;
+        V k2 = t & k0;
+        V b2 = k1 ^ k2;
+        V b3 = k1 & k2;
+
+        V next = K::next(b0, b1, b2, b3, mid, rule);
+        memcpy(out + r - 1, &next, sizeof(V));
+    }
+}
+
+#if !defined(__GNUC__)
+template <typename K>
+static void kernel_scalar(const uint64_t *c, const uint64_t *wi,
+        const uint64_t *ei, uint64_t *out, const Rule &rule) {
+    step_rows<uint64_t, K>(c, wi, ei, out, rule);
+}
+#else
+// 128-bit vectors lower to SSE2 on x86-64 and NEON on arm64
+typedef uint64_t v2u64 __attribute__((vector_size(16)));
+
+template <typename K>
+static void kernel_v2(const uint64_t *c, const uint64_t *wi,
+        const uint64_t *ei, uint64_t *out, const Rule &rule) {
+    step_rows<v2u64, K>(c, wi, ei, out, rule);
+}
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+typedef uint64_t v4u64 __attribute__((vector_size(32)));
+
+template <typename K>
+__attribute__((target("avx2")))
+static void kernel_avx2(const uint64_t *c, const uint64_t *wi,
+        const uint64_t *ei, uint64_t *out, const Rule &rule) {
+    step_rows<v4u64, K>(c, wi, ei, out, rule);
+}
+
+static bool cpu_has_avx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+template <typename K>
+static TileEngine::RowKernel kernel_for_cpu() {
+#if defined(__GNUC__) && defined(__x86_64__)
+    static const bool avx2 = cpu_has_avx2();
+    if(avx2) return kernel_avx2<K>;
+#endif
+#if defined(__GNUC__)
+    return kernel_v2<K>;
+#else
+    return kernel_scalar<K>;
+#endif
+}
+
+static TileEngine::RowKernel pick_kernel(const Rule &rule) {
+    if(rule == CONWAY) return kernel_for_cpu<ConwayKernel>();
+    if(rule == HIGHLIFE) {
+        return kernel_for_cpu<FixedKernel<HIGHLIFE.birth, HIGHLIFE.survive>>();
+    }
+    if(rule == DAY_AND_NIGHT) {
+        return kernel_for_cpu<FixedKernel<DAY_AND_NIGHT.birth,
+                                          DAY_AND_NIGHT.survive>>();
+    }
+    if(rule == SEEDS) {
+        return kernel_for_cpu<FixedKernel<SEEDS.birth, SEEDS.survive>>();
+    }
+    return kernel_for_cpu<GenericKernel>();
+}
+
+// n is the 3x3 neighbourhood of tiles, n[4] is the one being stepped
+void TileEngine::step_tile(const Tile *n[9], uint64_t *out) const {
+    constexpr unsigned S = TILE_SIZE;
+    uint64_t c[S + 2], wi[S + 2], ei[S + 2];
+
+    c[0] = n[1]->rows[S - 1];
+    wi[0] = n[0]->rows[S - 1] >> 63;
+    ei[0] = n[2]->rows[S - 1] << 63;
+
+    for(unsigned r = 0; r < S; r++) {
+        c[r + 1] = n[4]->rows[r];
+        wi[r + 1] = n[3]->rows[r] >> 63;
+        ei[r + 1] = n[5]->rows[r] << 63;
+    }
+
+    c[S + 1] = n[7]->rows[0];
+    wi[S + 1] = n[6]->rows[0] >> 63;
+    ei[S + 1] = n[8]->rows[0] << 63;
+
+    kernel(c, wi, ei, out, rule);
+}
+
+TileEngine::TileEngine() : kernel(pick_kernel(rule)) {}
+
+void TileEngine::set_rule(const Rule &r) {
+    rule = r;
+    kernel = pick_kernel(r);
+
+    // the carried-forward shortcuts only hold under the old rule
+    for(auto &[key, t] : tiles) t.same1 = t.same2 = false;
+}
+
+const TileEngine::Tile *TileEngine::find(uint32_t tx, uint32_t ty) const {
+    auto it = tiles.find(tile_key(tx & TILE_MASK, ty & TILE_MASK));
+    return it == tiles.end() ? &empty_tile : &it->second;
+}
+
+void TileEngine::set_board(const Board &board) {
+    // no history yet, so the first step recomputes everything
+    tiles.clear();
+    hash_valid = false;
+    changes_valid = false;
+    for(const Cell &c : board) {
+        uint32_t tx = c.first >> TILE_SHIFT, ty = c.second >> TILE_SHIFT;
+        Tile &t = tiles.try_emplace(tile_key(tx, ty)).first->second;
+        t.rows[c.second & (TILE_SIZE - 1)] |=
+            (uint64_t)1 << (c.first & (TILE_SIZE - 1));
+    }
+}
+
+void TileEngine::add_run(unsigned x, unsigned y, unsigned length) {
+    hash_valid = false;
+    changes_valid = false;
+    uint32_t ty = y >> TILE_SHIFT;
+    unsigned r = y & (TILE_SIZE - 1);
+
+    while(length > 0) {
+        unsigned bit = x & (TILE_SIZE - 1);
+        unsigned n = std::min(length, TILE_SIZE - bit);
+        uint64_t mask = n == TILE_SIZE ? ~(uint64_t)0 : (((uint64_t)1 << n) - 1);
+
+        Tile &t = tiles.try_emplace(tile_key(x >> TILE_SHIFT, ty)).first->second;
+        t.rows[r] |= mask << bit;
+        t.same1 = t.same2 = false;
+
+        x += n;
+        length -= n;
+    }
+}
+
+void TileEngine::add_word(unsigned x, unsigned y, uint64_t bits) {
+    if((x & (TILE_SIZE - 1)) != 0) {
+        Engine::add_word(x, y, bits);
+        return;
+    }
+    if(bits == 0) return;
+    hash_valid = false;
+    changes_valid = false;
+
+    Tile &t = tiles.try_emplace(tile_key(x >> TILE_SHIFT, y >> TILE_SHIFT)).first->second;
+    t.rows[y & (TILE_SIZE - 1)] |= bits;
+    t.same1 = t.same2 = false;
+}
+
+void TileEngine::add_block(const CellBlock &block) {
+    hash_valid = false;
+    changes_valid = false;
+    Tile &t = tiles.try_emplace(tile_key(block.x0 >> TILE_SHIFT, block.y0 >> TILE_SHIFT)).first->second;
+    for(unsigned r = 0; r < TILE_SIZE; r++) t.rows[r] |= block.rows[r];
+    t.same1 = t.same2 = false;
+}
+
+Board TileEngine::get_board() const {
+    Board board;
+    for(const auto &[key, t] : tiles) {
+        unsigned x0 = (uint32_t)key << TILE_SHIFT;
+        unsigned y0 = (uint32_t)(key >> 32) << TILE_SHIFT;
+
+        for(unsigned r = 0; r < TILE_SIZE; r++) {
+            for(uint64_t bits = t.rows[r]; bits; bits &= bits - 1) {
+                board.insert({x0 + __builtin_ctzll(bits), y0 + r});
+            }
+        }
+    }
+    return board;
+}
+
+void TileEngine::get_cells(std::vector<Cell> &cells) const {
+    cells.clear();
+    for(const auto &[key, t] : tiles) {
+        unsigned x0 = (uint32_t)key << TILE_SHIFT;
+        unsigned y0 = (uint32_t)(key >> 32) << TILE_SHIFT;
+
+        for(unsigned r = 0; r < TILE_SIZE; r++) {
+            for(uint64_t bits = t.rows[r]; bits; bits &= bits - 1) {
+                cells.push_back({x0 + __builtin_ctzll(bits), y0 + r});
+            }
+        }
+    }
+}
+
+bool TileEngine::bounding_box(int32_t &min_x, int32_t &min_y,
+                              int32_t &max_x, int32_t &max_y) const {
+    min_x = min_y = INT32_MAX;
+    max_x = max_y = INT32_MIN;
+
+    // tiles never straddle the signed wrap, so corner plus offset is exact
+    for(const auto &[key, t] : tiles) {
+        uint64_t columns = 0, rows = 0;
+        for(unsigned r = 0; r < TILE_SIZE; r++) {
+            columns |= t.rows[r];
+            if(t.rows[r]) rows |= (uint64_t)1 << r;
+        }
+        if(!rows) continue;
+
+        int32_t x0 = (int32_t)((uint32_t)key << TILE_SHIFT);
+        int32_t y0 = (int32_t)((uint32_t)(key >> 32) << TILE_SHIFT);
+        min_x = std::min(min_x, x0 + __builtin_ctzll(columns));
+        max_x = std::max(max_x, x0 + 63 - __builtin_clzll(columns));
+        min_y = std::min(min_y, y0 + __builtin_ctzll(rows));
+        max_y = std::max(max_y, y0 + 63 - __builtin_clzll(rows));
+    }
+    return min_x <= max_x;
+}
+
+void TileEngine::get_blocks(std::vector<CellBlock> &blocks) const {
+    static_assert(sizeof(CellBlock::rows) == sizeof(Tile::rows), "block and tile rows differ");
+
+    blocks.resize(tiles.size());
+    size_t i = 0;
+    for(const auto &[key, t] : tiles) {
+        CellBlock &b = blocks[i++];
+        b.x0 = (uint32_t)key << TILE_SHIFT;
+        b.y0 = (uint32_t)(key >> 32) << TILE_SHIFT;
+        memcpy(b.rows, t.rows, sizeof(b.rows));
+    }
+}
+
+void TileEngine::get_column(uint32_t x, std::vector<ColumnWord> &words) const {
+    words.clear();
+    uint32_t tx = x >> TILE_SHIFT;
+    unsigned bit = x & (TILE_SIZE - 1);
+
+    for(const auto &[key, t] : tiles) {
+        if((uint32_t)key != tx) continue;
+
+        uint64_t bits = 0;
+        for(unsigned r = 0; r < TILE_SIZE; r++) bits |= ((t.rows[r] >> bit) & 1) << r;
+        if(bits) words.push_back({(uint32_t)(key >> 32) << TILE_SHIFT, bits});
+    }
+}
+
+void TileEngine::add_column(uint32_t x, const std::vector<ColumnWord> &words) {
+    if(words.empty()) return;
+    hash_valid = false;
+    changes_valid = false;
+    unsigned bit = x & (TILE_SIZE - 1);
+
+    for(const auto &[y0, bits] : words) {
+        Tile &t = tiles.try_emplace(tile_key(x >> TILE_SHIFT, y0 >> TILE_SHIFT)).first->second;
+        for(uint64_t b = bits; b; b &= b - 1) t.rows[__builtin_ctzll(b)] |= (uint64_t)1 << bit;
+        t.same1 = t.same2 = false;
+    }
+}
+
+void TileEngine::crop_columns(uint32_t tx, uint32_t width, std::vector<CellBlock> *removed) {
+    hash_valid = false;
+    changes_valid = false;
+    for(auto it = tiles.begin(); it != tiles.end();) {
+        uint32_t offset = ((uint32_t)it->first - tx) & TILE_MASK;
+        Tile &t = it->second;
+
+        if(offset < width) {
+            if(offset == 0 || offset == width - 1) t.same1 = t.same2 = false;
+            ++it;
+            continue;
+        }
+
+        if(removed) {
+            uint64_t any = 0;
+            for(unsigned r = 0; r < TILE_SIZE; r++) any |= t.rows[r];
+            if(any) {
+                removed->emplace_back();
+                CellBlock &b = removed->back();
+                b.x0 = (uint32_t)it->first << TILE_SHIFT;
+                b.y0 = (uint32_t)(it->first >> 32) << TILE_SHIFT;
+                memcpy(b.rows, t.rows, sizeof(b.rows));
+            }
+        }
+        it = tiles.erase(it);
+    }
+}
+
+size_t TileEngine::population() const {
+    size_t pop = 0;
+    for(const auto &[key, t] : tiles) {
+        for(unsigned r = 0; r < TILE_SIZE; r++) {
+            pop += __builtin_popcountll(t.rows[r]);
+        }
+    }
+    return pop;
+}
+
+// Hash of one tile's rows relative to its corner
+static uint64_t rows_hash(const uint64_t *rows) {
+    uint64_t h = 0;
+    for(unsigned r = 0; r < TileEngine::TILE_SIZE; r++) {
+        if(rows[r]) h += hash_row(rows[r]) * HASH_TABLES.pow_y[0][r];
+    }
+    return h;
+}
+
+static uint64_t tile_corner_hash(uint64_t key) {
+    int32_t x0 = (int32_t)((uint32_t)key << TileEngine::TILE_SHIFT);
+    int32_t y0 = (int32_t)((uint32_t)(key >> 32) << TileEngine::TILE_SHIFT);
+    return hash_pow_x(x0) * hash_pow_y(y0);
+}
+
+uint64_t TileEngine::hash() const {
+    if(!hash_valid) {
+        hash_value = 0;
+        for(const auto &[key, t] : tiles) {
+            t.hash = rows_hash(t.rows);
+            t.prev_hash = rows_hash(t.prev);
+            hash_value += t.hash * tile_corner_hash(key);
+        }
+        hash_valid = true;
+    }
+    return hash_value;
+}
+
+void TileEngine::step() {
+    constexpr uint64_t LEFT = 1, RIGHT = (uint64_t)1 << 63;
+    METRICS_GENERATION(*this, 1);
+
+    // every live tile, plus any neighbour its edge cells can reach
+    METRICS_BEGIN(PHASE_CANDIDATES);
+    candidates.clear();
+    for(const auto &[key, t] : tiles) {
+        uint32_t tx = (uint32_t)key, ty = (uint32_t)(key >> 32);
+
+        uint64_t edges = 0;
+        for(unsigned r = 0; r < TILE_SIZE; r++) edges |= t.rows[r];
+
+        bool top = t.rows[0], bottom = t.rows[TILE_SIZE - 1];
+        bool left = edges & LEFT, right = edges & RIGHT;
+
+        candidates.push_back(key);
+        for(int dy = -1; dy <= 1; dy++) {
+            for(int dx = -1; dx <= 1; dx++) {
+                if(dx == 0 && dy == 0) continue;
+                if(dy == -1 && !top) continue;
+                if(dy == 1 && !bottom) continue;
+                if(dx == -1 && !left) continue;
+                if(dx == 1 && !right) continue;
+
+                // corners need the corner cell itself
+                if(dx && dy) {
+                    const uint64_t &row = t.rows[dy < 0 ? 0 : TILE_SIZE - 1];
+                    if(!(row & (dx < 0 ? LEFT : RIGHT))) continue;
+                }
+                candidates.push_back(tile_key((tx + dx) & TILE_MASK,
+                                              (ty + dy) & TILE_MASK));
+            }
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                     candidates.end());
+    METRICS_END(PHASE_CANDIDATES);
+    METRICS_COUNT(COUNTER_CANDIDATES, candidates.size());
+
+    METRICS_BEGIN(PHASE_COMPUTE);
+    next_tiles.clear();
+    next_tiles.reserve(candidates.size());
+
+    active = 0;
+    uint64_t hash_delta = 0;
+
+    Tile out;
+    for(uint64_t key : candidates) {
+        uint32_t tx = (uint32_t)key, ty = (uint32_t)(key >> 32);
+
+        const Tile *n[9];
+        bool stable = true, period2 = true;
+        for(int dy = -1, i = 0; dy <= 1; dy++) {
+            for(int dx = -1; dx <= 1; dx++, i++) {
+                n[i] = find(tx + dx, ty + dy);
+                stable = stable && n[i]->same1;
+                period2 = period2 && n[i]->same2;
+            }
+        }
+
+        const Tile &cur = *n[4];
+        if(stable) {
+            memcpy(out.rows, cur.rows, sizeof(out.rows));
+            out.same1 = true;
+            out.same2 = cur.same1;
+            out.hash = cur.hash;
+        } else if(period2) {
+            memcpy(out.rows, cur.prev, sizeof(out.rows));
+            out.same1 = cur.same1;
+            out.same2 = true;
+            out.hash = cur.prev_hash;
+        } else {
+            step_tile(n, out.rows);
+            out.same1 = !memcmp(out.rows, cur.rows, sizeof(out.rows));
+            out.same2 = !memcmp(out.rows, cur.prev, sizeof(out.rows));
+            if(hash_valid) out.hash = rows_hash(out.rows);
+            active++;
+        }
+        memcpy(out.prev, cur.rows, sizeof(out.prev));
+        out.prev_hash = cur.hash;
+
+        if(hash_valid && out.hash != cur.hash) {
+            hash_delta += (out.hash - cur.hash) * tile_corner_hash(key);
+        }
+
+        // Only drop a tile once it has been empty for three generations,
+        // that's what empty_tile claims about the ones that are missing.
+        uint64_t any = 0;
+        for(unsigned r = 0; r < TILE_SIZE; r++) any |= out.rows[r] | out.prev[r];
+        if(any || !out.same2) next_tiles.emplace(key, out);
+    }
+    METRICS_END(PHASE_COMPUTE);
+    METRICS_COUNT(COUNTER_ACTIVE, active);
+
+    hash_value += hash_delta;
+    tiles.swap(next_tiles);
+    changes_valid = true;
+}
+
+bool TileEngine::get_changes(CellChanges &changes) const {
+    changes.clear();
+    if(!changes_valid) return false;
+
+    // prev is the generation before, and only tiles without same1 differ
+    for(const auto &[key, t] : tiles) {
+        if(t.same1) continue;
+        unsigned x0 = (uint32_t)key << TILE_SHIFT;
+        unsigned y0 = (uint32_t)(key >> 32) << TILE_SHIFT;
+
+        for(unsigned r = 0; r < TILE_SIZE; r++) {
+            for(uint64_t bits = t.rows[r] & ~t.prev[r]; bits; bits &= bits - 1) {
+                changes.born.push_back({x0 + __builtin_ctzll(bits), y0 + r});
+            }
+            for(uint64_t bits = t.prev[r] & ~t.rows[r]; bits; bits &= bits - 1) {
+                changes.died.push_back({x0 + __builtin_ctzll(bits), y0 + r});
+            }
+        }
+    }
+    return true;
+}
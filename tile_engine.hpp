@@ -0,0 +1,110 @@
+#ifndef TILE_ENGINE_HPP
+#define TILE_ENGINE_HPP
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "engine.hpp"
+
+// Dense engine: the plane is cut into 64x64 tiles, each row of a tile is
+// one 64-bit word (bit i of row r is cell (tx*64 + i, ty*64 + r)).
+// Only tiles with live cells are stored. Coordinates wrap at 2^32 the same
+// way the unsigned Cell arithmetic does.
+//
+// Each tile also remembers its previous generation. A tile whose whole 3x3
+// neighbourhood didn't change last step is carried forward untouched, and
+// one whose neighbourhood is back where it was two steps ago just flips to
+// its previous state, so still lifes and period 2 debris cost nothing.
+class TileEngine : public Engine {
+public:
+    static constexpr unsigned TILE_SHIFT = 6;
+    static constexpr unsigned TILE_SIZE = 1u << TILE_SHIFT;
+    static constexpr uint32_t TILE_MASK = (1u << (32 - TILE_SHIFT)) - 1;
+
+    typedef void (*RowKernel)(const uint64_t *c, const uint64_t *wi,
+            const uint64_t *ei, uint64_t *out, const Rule &rule);
+
+    struct Tile {
+        uint64_t rows[TILE_SIZE];
+        uint64_t prev[TILE_SIZE];
+        // hashes of rows and prev relative to the tile corner, only kept
+        // up while the engine is tracking its hash
+        mutable uint64_t hash, prev_hash;
+        bool same1; // rows == generation before
+        bool same2; // rows == two generations before
+    };
+
+    TileEngine();
+
+    const char *name() const override { return "tile"; }
+
+    // picks a kernel compiled for the rule if there is one
+    void set_rule(const Rule &r) override;
+
+    void set_board(const Board &board) override;
+    Board get_board() const override;
+    void get_cells(std::vector<Cell> &cells) const override;
+    void get_blocks(std::vector<CellBlock> &blocks) const override;
+    // the tiles already are blocks, a straight copy
+    void snapshot(BoardSnapshot &s) const override {
+        s.cells.clear();
+        get_blocks(s.blocks);
+    }
+    bool bounding_box(int32_t &min_x, int32_t &min_y,
+                      int32_t &max_x, int32_t &max_y) const override;
+
+    void clear() override { tiles.clear(); hash_valid = false; changes_valid = false; }
+    // ORs whole word-aligned spans into the tile rows
+    void add_run(unsigned x, unsigned y, unsigned length) override;
+    void add_word(unsigned x, unsigned y, uint64_t bits) override;
+    void add_block(const CellBlock &block) override;
+
+    void step() override;
+    size_t population() const override;
+    uint64_t hash() const override;
+    // every tile keeps its previous rows anyway, so always on
+    bool get_changes(CellChanges &changes) const override;
+
+    size_t tile_count() const { return tiles.size(); }
+
+    // tiles actually recomputed by the last step()
+    size_t active_tiles() const override { return active; }
+
+    // Sharding (shard.hpp) gives each process a band of whole tile
+    // columns. A column of cells travels as (y0, bits) words, bit i is
+    // cell (x, y0 + i) and y0 is a multiple of TILE_SIZE.
+    typedef std::pair<uint32_t, uint64_t> ColumnWord;
+    void get_column(uint32_t x, std::vector<ColumnWord> &words) const;
+    void add_column(uint32_t x, const std::vector<ColumnWord> &words);
+
+    // Drops every tile outside the `width` tile columns starting at tx,
+    // appending the ones with live cells to removed. Tiles left on either
+    // edge of the band lose their shortcuts, since whatever was next to
+    // them has just changed under them.
+    void crop_columns(uint32_t tx, uint32_t width,
+                      std::vector<CellBlock> *removed = nullptr);
+
+    static uint64_t tile_key(uint32_t tx, uint32_t ty) {
+        return ((uint64_t)ty << 32) | tx;
+    }
+
+private:
+    const Tile *find(uint32_t tx, uint32_t ty) const;
+    void step_tile(const Tile *n[9], uint64_t *out) const;
+
+    RowKernel kernel;
+
+    std::unordered_map<uint64_t, Tile> tiles;
+    std::unordered_map<uint64_t, Tile> next_tiles;
+    std::vector<uint64_t> candidates;
+    size_t active = 0;
+
+    // only maintained by step() once hash() has been called
+    mutable uint64_t hash_value = 0;
+    mutable bool hash_valid = false;
+    // prev holds the generation before rows, nothing added since the step
+    bool changes_valid = false;
+};
+
+#endif // TILE_ENGINE_HPP
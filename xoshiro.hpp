@@ -0,0 +1,40 @@
+#ifndef XOSHIRO_HPP
+#define XOSHIRO_HPP
+
+#include <cstdint>
+
+// xoshiro256** (Blackman & Vigna). Small state, no locks, so every worker
+// or every soup can have its own instead of sharing rand().
+class Xoshiro256 {
+public:
+    explicit Xoshiro256(uint64_t seed) {
+        // splitmix64 to spread the seed over the whole state
+        for (uint64_t &word : s) {
+            seed += 0x9E3779B97F4A7C15ull;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t next() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+private:
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    uint64_t s[4];
+};
+
+#endif // XOSHIRO_HPP